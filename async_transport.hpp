@@ -0,0 +1,167 @@
+#ifndef IRODS_INDEXING_ASYNC_TRANSPORT_HPP
+#define IRODS_INDEXING_ASYNC_TRANSPORT_HPP
+
+// keeps up to max_in_flight requests to elasticsearch outstanding at once so
+// that a caller may prepare the next bulk while earlier ones are in transit.
+// each sender thread owns its own client, as elasticlient clients are not
+// safe to share between threads, and senders are started only as requests
+// overlap.  submit blocks while the limit is reached, completion callbacks
+// run on the sender threads and are handed back the request body so that its
+// storage may be reused for a later request, along with the client of the
+// sender so that they may send follow up requests of their own.
+
+#include "host_selector.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace irods::indexing {
+
+    class async_transport {
+    public:
+        // given the response, or the exception should no host have answered,
+        // the body which was sent and the client which sent it
+        using callback_type = std::function<void(const cpr::Response&, std::exception_ptr, std::string&, elasticsearch_client&)>;
+
+        async_transport(
+              const client_configuration& _cfg
+            , const uint32_t              _max_in_flight)
+            : cfg_{_cfg}
+            , max_in_flight_{std::max(_max_in_flight, 1u)}
+        {
+        }
+
+        ~async_transport()
+        {
+            wait();
+
+            {
+                std::lock_guard lk{mutex_};
+                stopping_ = true;
+            }
+            work_cv_.notify_all();
+
+            for(auto&& t : senders_) {
+                t.join();
+            }
+        }
+
+        async_transport(const async_transport&) = delete;
+        async_transport& operator=(const async_transport&) = delete;
+
+        void submit(
+              elasticlient::Client::HTTPMethod _method
+            , std::string                      _path
+            , std::string                      _body
+            , callback_type                    _callback)
+        {
+            std::unique_lock lk{mutex_};
+
+            space_cv_.wait(lk, [this] { return in_flight_ < max_in_flight_; });
+
+            ++in_flight_;
+            queue_.push_back({_method, std::move(_path), std::move(_body), std::move(_callback)});
+
+            if(0 == idle_ && senders_.size() < max_in_flight_) {
+                senders_.emplace_back([this] { run(); });
+            }
+
+            lk.unlock();
+            work_cv_.notify_one();
+
+        } // submit
+
+        // block until every submitted request has completed
+        void wait()
+        {
+            std::unique_lock lk{mutex_};
+            done_cv_.wait(lk, [this] { return 0 == in_flight_; });
+        }
+
+    private:
+        struct request {
+            elasticlient::Client::HTTPMethod method;
+            std::string                      path;
+            std::string                      body;
+            callback_type                    callback;
+        };
+
+        void run()
+        {
+            elasticsearch_client client{cfg_};
+
+            while(true) {
+                request r;
+
+                {
+                    std::unique_lock lk{mutex_};
+
+                    ++idle_;
+                    work_cv_.wait(lk, [this] { return stopping_ || !queue_.empty(); });
+                    --idle_;
+
+                    if(queue_.empty()) {
+                        return;
+                    }
+
+                    r = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+
+                cpr::Response response{};
+                std::exception_ptr error;
+
+                try {
+                    response = client.performRequest(r.method, r.path, r.body);
+                }
+                catch(...) {
+                    error = std::current_exception();
+                }
+
+                try {
+                    r.callback(response, error, r.body, client);
+                }
+                catch(...) {
+                    // a callback may not take the sender down with it
+                }
+
+                {
+                    std::lock_guard lk{mutex_};
+                    --in_flight_;
+                }
+
+                space_cv_.notify_one();
+                done_cv_.notify_all();
+            }
+
+        } // run
+
+        const client_configuration cfg_;
+        const uint32_t             max_in_flight_;
+
+        std::mutex                 mutex_;
+        std::condition_variable    work_cv_;
+        std::condition_variable    space_cv_;
+        std::condition_variable    done_cv_;
+        std::deque<request>        queue_;
+        std::vector<std::thread>   senders_;
+        // submitted and not yet completed, queued or in transit
+        uint32_t                   in_flight_{};
+        uint32_t                   idle_{};
+        bool                       stopping_{};
+
+    }; // class async_transport
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_ASYNC_TRANSPORT_HPP
@@ -0,0 +1,274 @@
+#ifndef IRODS_INDEXING_ATTRIBUTE_FILTER_HPP
+#define IRODS_INDEXING_ATTRIBUTE_FILTER_HPP
+
+// selection of the avus indexed by the metadata policies.  the attributes
+// and units of an avu are matched against include and exclude lists, each
+// entry of which is an exact name as a string, or an object holding a glob
+// or a regular expression which must match the whole name:
+//
+//     "include_attributes" : ["title", {"glob" : "dc.*"}],
+//     "exclude_units"      : [{"regex" : "tmp_[0-9]+"}]
+//
+// an avu is indexed when its attribute and units are each matched by their
+// include list, or that list is empty, and by neither exclude list.  the
+// lists are compiled once per configuration and shared by every invocation
+// of the policy: exact names into a hash set, globs which only end in a *
+// into prefixes, and every other glob and expression into one regex.
+
+#include "utilities.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <unordered_set>
+
+namespace irods::indexing {
+
+    class pattern_set {
+    public:
+        explicit pattern_set(const json& _patterns)
+        {
+            if(!_patterns.is_array()) {
+                THROW(
+                    SYS_INVALID_INPUT_PARAM,
+                    fmt::format("invalid attribute filter [{}], expected a list", _patterns.dump()));
+            }
+
+            std::string expression;
+
+            auto add_expression = [&expression](const std::string& _e) {
+                expression += fmt::format("{}(?:{})", expression.empty() ? "" : "|", _e);
+            };
+
+            for(auto&& p : _patterns) {
+                if(p.is_string()) {
+                    exact_.insert(p.get<std::string>());
+                }
+                else if(p.is_object() && p.contains("glob")) {
+                    const auto glob = p.at("glob").get<std::string>();
+                    const auto wild = glob.find_first_of("*?[");
+
+                    if(std::string::npos == wild) {
+                        exact_.insert(glob);
+                    }
+                    else if(glob.size() - 1 == wild && '*' == glob.back()) {
+                        prefixes_.push_back(glob.substr(0, wild));
+                    }
+                    else {
+                        add_expression(glob_to_regex(glob));
+                    }
+                }
+                else if(p.is_object() && p.contains("regex")) {
+                    add_expression(p.at("regex").get<std::string>());
+                }
+                else {
+                    THROW(
+                        SYS_INVALID_INPUT_PARAM,
+                        fmt::format("invalid attribute filter pattern [{}]", p.dump()));
+                }
+            }
+
+            if(!expression.empty()) {
+                try {
+                    regex_.emplace(expression, std::regex::ECMAScript | std::regex::optimize);
+                }
+                catch(const std::regex_error& _e) {
+                    THROW(
+                        SYS_INVALID_INPUT_PARAM,
+                        fmt::format("invalid attribute filter expression [{}] [{}]", expression, _e.what()));
+                }
+            }
+
+        } // ctor
+
+        bool empty() const
+        {
+            return exact_.empty() && prefixes_.empty() && !regex_;
+        }
+
+        bool matches(const std::string& _name) const
+        {
+            if(exact_.count(_name)) {
+                return true;
+            }
+
+            for(auto&& p : prefixes_) {
+                if(0 == _name.compare(0, p.size(), p)) {
+                    return true;
+                }
+            }
+
+            return regex_ && std::regex_match(_name, *regex_);
+
+        } // matches
+
+    private:
+        static std::string glob_to_regex(const std::string& _glob)
+        {
+            std::string r;
+
+            for(std::size_t i = 0; i < _glob.size(); ++i) {
+                const auto c = _glob[i];
+
+                if('*' == c) {
+                    r += ".*";
+                }
+                else if('?' == c) {
+                    r += '.';
+                }
+                else if('[' == c && std::string::npos != _glob.find(']', i + 1)) {
+                    // a bracket expression is passed through, negated by ! or ^
+                    const auto end = _glob.find(']', i + 1);
+                    auto set = _glob.substr(i + 1, end - i - 1);
+                    if(!set.empty() && '!' == set.front()) {
+                        set.front() = '^';
+                    }
+                    r += '[' + set + ']';
+                    i = end;
+                }
+                else {
+                    if(std::string::npos != std::string{"\\^$.|+()[]{}"}.find(c)) {
+                        r += '\\';
+                    }
+                    r += c;
+                }
+            }
+
+            return r;
+
+        } // glob_to_regex
+
+        std::unordered_set<std::string> exact_;
+        std::vector<std::string>        prefixes_;
+        std::optional<std::regex>       regex_;
+
+    }; // class pattern_set
+
+    class attribute_filter {
+    public:
+        attribute_filter(
+              const json& _include_attributes
+            , const json& _exclude_attributes
+            , const json& _include_units
+            , const json& _exclude_units)
+            : include_attributes_{_include_attributes}
+            , exclude_attributes_{_exclude_attributes}
+            , include_units_{_include_units}
+            , exclude_units_{_exclude_units}
+        {
+        }
+
+        bool accepts(
+              const std::string& _attribute
+            , const std::string& _units) const
+        {
+            if(!include_attributes_.empty() && !include_attributes_.matches(_attribute)) {
+                return false;
+            }
+
+            if(exclude_attributes_.matches(_attribute)) {
+                return false;
+            }
+
+            if(!include_units_.empty() && !include_units_.matches(_units)) {
+                return false;
+            }
+
+            return !exclude_units_.matches(_units);
+
+        } // accepts
+
+        // the avus of an object which are to be indexed
+        auto select(const std::vector<fs::metadata>& _avus) const
+        {
+            std::vector<fs::metadata> selected;
+            selected.reserve(_avus.size());
+
+            for(auto&& avu : _avus) {
+                if(accepts(avu.attribute, avu.units)) {
+                    selected.push_back(avu);
+                }
+            }
+
+            return selected;
+
+        } // select
+
+    private:
+        pattern_set include_attributes_;
+        pattern_set exclude_attributes_;
+        pattern_set include_units_;
+        pattern_set exclude_units_;
+
+    }; // class attribute_filter
+
+    // the filters compiled by this process, keyed by their configuration
+    class attribute_filters {
+    public:
+        static attribute_filters& instance()
+        {
+            static attribute_filters f;
+            return f;
+        }
+
+        std::shared_ptr<const attribute_filter> get(
+              const json& _include_attributes
+            , const json& _exclude_attributes
+            , const json& _include_units
+            , const json& _exclude_units)
+        {
+            const auto key = json::array({
+                                 _include_attributes
+                               , _exclude_attributes
+                               , _include_units
+                               , _exclude_units}).dump();
+
+            std::lock_guard lk{mutex_};
+
+            auto it = filters_.find(key);
+            if(it != filters_.end()) {
+                return it->second;
+            }
+
+            auto f = std::make_shared<const attribute_filter>(
+                         _include_attributes
+                       , _exclude_attributes
+                       , _include_units
+                       , _exclude_units);
+
+            filters_[key] = f;
+
+            return f;
+
+        } // get
+
+    private:
+        attribute_filters() = default;
+
+        std::mutex                                                     mutex_;
+        std::map<std::string, std::shared_ptr<const attribute_filter>> filters_;
+
+    }; // class attribute_filters
+
+    auto get_attribute_filter(const pe::configuration_manager& _cfg)
+    {
+        // the avus which drive the indexing policies are not themselves indexed
+        const auto indexing_avus = json::array({json{{"glob", "irods::indexing::*"}}});
+
+        // clang-format off
+        return attribute_filters::instance().get(
+                   _cfg.get("include_attributes", json::array())
+                 , _cfg.get("exclude_attributes", indexing_avus)
+                 , _cfg.get("include_units",      json::array())
+                 , _cfg.get("exclude_units",      json::array()));
+        // clang-format on
+
+    } // get_attribute_filter
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_ATTRIBUTE_FILTER_HPP
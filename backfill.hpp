@@ -0,0 +1,375 @@
+#ifndef IRODS_INDEXING_BACKFILL_HPP
+#define IRODS_INDEXING_BACKFILL_HPP
+
+#include "utilities.hpp"
+#include "checkpoint.hpp"
+#include "work_stealing_pool.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include <atomic>
+#include <chrono>
+
+namespace irods::indexing {
+
+    struct object_entry {
+        std::string id;
+        std::string logical_path;
+        std::string checksum;
+        // only gathered by a set based metadata backfill
+        std::vector<fs::metadata> avus;
+        // the content read while computing a full text checksum, if kept
+        std::string content;
+    };
+
+    using object_batch = std::vector<object_entry>;
+
+    namespace avu_extraction {
+        // the avus of each object are fetched as its batch is indexed
+        const std::string per_object{"per_object"};
+        // the avus of the whole collection tree are fetched with the
+        // objects, by a single query ordered by object
+        const std::string set_based{"set"};
+    }
+
+    struct backfill_configuration {
+        uint32_t    threads;
+        uint32_t    batch_size;
+        uint64_t    progress_interval;
+        // how a metadata backfill gathers the avus of the objects
+        std::string avus;
+    };
+
+    auto get_backfill_configuration(const pe::configuration_manager& _cfg)
+    {
+        // clang-format off
+        const auto threads  = _cfg.get("backfill_threads",           uint32_t{4});
+        const auto batch    = _cfg.get("backfill_batch_size",        uint32_t{1000});
+        const auto progress = _cfg.get("backfill_progress_interval", uint64_t{10000});
+        const auto avus     = _cfg.get("backfill_avus",              avu_extraction::per_object);
+        // clang-format on
+
+        if(avu_extraction::per_object != avus && avu_extraction::set_based != avus) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid backfill_avus [{}]", avus));
+        }
+
+        return backfill_configuration{threads, batch, progress, avus};
+
+    } // get_backfill_configuration
+
+    // a backfill is requested explicitly with "mode" : "backfill" when the
+    // indexing avu is applied to a collection.  otherwise the policy indexes
+    // the collection itself, and the query processor each of its objects.
+    auto is_collection_backfill(
+          rsComm_t*          _comm
+        , const json&        _params
+        , const std::string& _logical_path)
+    {
+        if(!_params.contains("mode") || "backfill" != _params.at("mode")) {
+            return false;
+        }
+
+        return invoked_for_collection(_comm, _params, _logical_path);
+
+    } // is_collection_backfill
+
+    // walk every data object in the collection tree in DATA_ID order with a
+    // single paged general query, handing ids, paths and checksums to the
+    // callback in batches.  objects at or below the cursor are skipped.
+    template <typename Function>
+    void for_each_object_batch(
+          rsComm_t*          _comm
+        , const std::string& _collection
+        , const uint32_t     _batch_size
+        , const std::string& _cursor
+        , Function           _function)
+    {
+        auto qstr = fmt::format(
+            "SELECT ORDER(DATA_ID), COLL_NAME, DATA_NAME, DATA_CHECKSUM, DATA_REPL_STATUS WHERE COLL_NAME = '{0}' || like '{0}/%'"
+            , _collection);
+
+        if(!_cursor.empty()) {
+            qstr += fmt::format(" AND DATA_ID > '{}'", _cursor);
+        }
+
+        object_batch batch;
+        batch.reserve(_batch_size);
+
+        object_entry entry{};
+        bool good_replica{false};
+
+        // the connection is held while the query pages and released while
+        // the batch is handed off, which may wait on the threads reading
+        std::unique_lock lk{connection_mutex(_comm)};
+
+        auto push = [&] {
+            batch.push_back(std::move(entry));
+            if(batch.size() >= _batch_size) {
+                lk.unlock();
+                _function(std::move(batch));
+                lk.lock();
+                batch = object_batch{};
+                batch.reserve(_batch_size);
+            }
+        };
+
+        // rows for the replicas of an object are adjacent, prefer the
+        // checksum of a good replica
+        {
+            irods::query<rsComm_t> qobj{_comm, qstr};
+            for(const auto& row : qobj) {
+                if(row[0] != entry.id) {
+                    if(!entry.id.empty()) {
+                        push();
+                    }
+
+                    entry = object_entry{row[0], (fs::path{row[1]} / row[2]).string(), row[3]};
+                    good_replica = ("1" == row[4]);
+                    continue;
+                }
+
+                if(!row[3].empty() && (entry.checksum.empty() || (!good_replica && "1" == row[4]))) {
+                    entry.checksum = row[3];
+                    good_replica   = ("1" == row[4]);
+                }
+            } // for row
+
+            if(!entry.id.empty()) {
+                push();
+            }
+        }
+
+        lk.unlock();
+
+        if(!batch.empty()) {
+            _function(std::move(batch));
+        }
+
+    } // for_each_object_batch
+
+    // walk every avu of every data object in the collection tree in DATA_ID
+    // order with a single paged general query, handing ids, paths and avus
+    // to the callback in batches.  the rows of an object are adjacent and
+    // are gathered as they stream by, objects without avus do not appear.
+    // objects at or below the cursor are skipped.
+    template <typename Function>
+    void for_each_object_avu_batch(
+          rsComm_t*          _comm
+        , const std::string& _collection
+        , const uint32_t     _batch_size
+        , const std::string& _cursor
+        , Function           _function)
+    {
+        auto qstr = fmt::format(
+            "SELECT ORDER(DATA_ID), COLL_NAME, DATA_NAME, META_DATA_ATTR_NAME, META_DATA_ATTR_VALUE, META_DATA_ATTR_UNITS WHERE COLL_NAME = '{0}' || like '{0}/%'"
+            , _collection);
+
+        if(!_cursor.empty()) {
+            qstr += fmt::format(" AND DATA_ID > '{}'", _cursor);
+        }
+
+        object_batch batch;
+        batch.reserve(_batch_size);
+
+        object_entry entry{};
+
+        // the connection is held while the query pages and released while
+        // the batch is handed off, which may wait on the threads reading
+        std::unique_lock lk{connection_mutex(_comm)};
+
+        auto push = [&] {
+            batch.push_back(std::move(entry));
+            if(batch.size() >= _batch_size) {
+                lk.unlock();
+                _function(std::move(batch));
+                lk.lock();
+                batch = object_batch{};
+                batch.reserve(_batch_size);
+            }
+        };
+
+        {
+            irods::query<rsComm_t> qobj{_comm, qstr};
+            for(const auto& row : qobj) {
+                if(row[0] != entry.id) {
+                    if(!entry.id.empty()) {
+                        push();
+                    }
+
+                    entry = object_entry{row[0], (fs::path{row[1]} / row[2]).string(), {}, {}};
+                }
+
+                entry.avus.push_back(fs::metadata{row[3], row[4], row[5]});
+            } // for row
+
+            if(!entry.id.empty()) {
+                push();
+            }
+        }
+
+        lk.unlock();
+
+        if(!batch.empty()) {
+            _function(std::move(batch));
+        }
+
+    } // for_each_object_avu_batch
+
+    // index every data object within a collection tree.  the batch function
+    // returns the number of objects which failed, errors are tallied and
+    // reported rather than stopping the run.  a run resumes from the cursor
+    // of its checkpoint, which is removed once the run completes without
+    // errors.  the producer walks the objects after a cursor, handing them
+    // to its callback in batches.
+    template <typename Producer, typename Function>
+    irods::error run_backfill(
+          rsComm_t*                     _comm
+        , const std::string&            _collection
+        , const std::string&            _index_name
+        , const backfill_configuration& _config
+        , const checkpoint&             _checkpoint
+        , Producer                      _producer
+        , Function                      _function)
+    {
+        using clock_type = std::chrono::steady_clock;
+
+        const auto start = clock_type::now();
+
+        std::atomic<uint64_t> objects{};
+        std::atomic<uint64_t> errors{};
+
+        auto report = [&](const char* _state, const uint64_t _objects) {
+            const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                                     clock_type::now() - start).count();
+            rodsLog(
+                LOG_NOTICE
+              , "backfill %s for [%s] in [%s] objects [%llu] errors [%llu] elapsed [%lld]s rate [%llu]/s"
+              , _state
+              , _collection.c_str()
+              , _index_name.c_str()
+              , static_cast<unsigned long long>(_objects)
+              , static_cast<unsigned long long>(errors.load())
+              , static_cast<long long>(seconds)
+              , static_cast<unsigned long long>(seconds > 0 ? _objects / seconds : _objects));
+        };
+
+        const auto cursor = _checkpoint.enabled() ? _checkpoint.load() : std::string{};
+        if(!cursor.empty()) {
+            rodsLog(
+                LOG_NOTICE
+              , "backfill resuming for [%s] in [%s] after data id [%s]"
+              , _collection.c_str()
+              , _index_name.c_str()
+              , cursor.c_str());
+        }
+
+        report("started", 0);
+
+        checkpoint_tracker tracker{_checkpoint};
+
+        // batches are traced beneath the invocation on the pool threads
+        const auto context = current_trace_context();
+
+        try {
+            work_stealing_pool pool{_config.threads};
+
+            _producer(
+                cursor
+              , [&](object_batch&& _batch) {
+                  pool.submit(
+                      [&, sequence = tracker.next_sequence(), batch = std::move(_batch)] {
+                          trace_attachment attachment{context};
+                          span s{"backfill_batch"};
+                          s.set("objects", batch.size());
+
+                          uint64_t failed{};
+                          try {
+                              failed = _function(batch);
+                          }
+                          catch(const irods::exception& _e) {
+                              rodsLog(LOG_ERROR, "backfill batch failed [%s]", _e.what());
+                              failed = batch.size();
+                          }
+                          catch(const std::exception& _e) {
+                              rodsLog(LOG_ERROR, "backfill batch failed [%s]", _e.what());
+                              failed = batch.size();
+                          }
+
+                          s.set("failed", failed);
+
+                          errors += failed;
+                          tracker.complete(sequence, batch.back().id, batch.size(), failed);
+
+                          const auto before = objects.fetch_add(batch.size());
+                          const auto after  = before + batch.size();
+
+                          if(_config.progress_interval > 0
+                             && before / _config.progress_interval != after / _config.progress_interval) {
+                              report("progress", after);
+                          }
+                      });
+              });
+
+            pool.wait();
+        }
+        catch(const irods::exception& _e) {
+            tracker.flush();
+            report("aborted", objects.load());
+            return ERROR(
+                       _e.code(),
+                       fmt::format("backfill of [{}] in [{}] aborted [{}]"
+                       , _collection
+                       , _index_name
+                       , _e.what()));
+        }
+
+        report("completed", objects.load());
+
+        // a run with errors keeps its checkpoint before the first failed batch
+        if(errors > 0) {
+            tracker.flush();
+        }
+        else {
+            remove_checkpoint(_checkpoint);
+        }
+
+        if(errors > 0) {
+            return ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("backfill of [{}] in [{}] encountered {} errors"
+                       , _collection
+                       , _index_name
+                       , errors.load()));
+        }
+
+        return SUCCESS();
+
+    } // run_backfill
+
+    template <typename Function>
+    irods::error run_backfill(
+          rsComm_t*                     _comm
+        , const std::string&            _collection
+        , const std::string&            _index_name
+        , const backfill_configuration& _config
+        , const checkpoint&             _checkpoint
+        , Function                      _function)
+    {
+        return run_backfill(
+                   _comm
+                 , _collection
+                 , _index_name
+                 , _config
+                 , _checkpoint
+                 , [&](const std::string& _cursor, auto&& _callback) {
+                     for_each_object_batch(_comm, _collection, _config.batch_size, _cursor, _callback);
+                 }
+                 , _function);
+
+    } // run_backfill
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_BACKFILL_HPP
@@ -0,0 +1,659 @@
+#ifndef IRODS_INDEXING_BULK_HPP
+#define IRODS_INDEXING_BULK_HPP
+
+#include "utilities.hpp"
+#include "indexing_daemon_client.hpp"
+#include "host_selector.hpp"
+#include "async_transport.hpp"
+#include "bulk_response.hpp"
+#include "qos.hpp"
+#include "rollover.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace irods::indexing {
+
+    // send again the items of a bulk which failed transiently, waiting out
+    // a growing backoff before each attempt, and report those which still
+    // failed.  the offsets give the start of each item within the body.
+    irods::error check_bulk_response(
+          elasticsearch_client&           _client
+        , const cpr::Response&            _response
+        , const std::string&              _body
+        , const std::vector<std::size_t>& _offsets
+        , const std::string&              _logical_path)
+    {
+        const auto count = _offsets.size();
+
+        if(_response.status_code != 200) {
+            return ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("bulk request of {} documents failed for [{}] code [{}] message [{}]"
+                        , count
+                        , _logical_path
+                        , _response.status_code
+                        , _response.text));
+        }
+
+        // an update without an upsert of a document which does not exist
+        // has nothing to update
+        auto get_failures = [](const std::string& _text) {
+            auto f = get_bulk_failures(_text);
+            f.erase(
+                std::remove_if(
+                    f.begin()
+                  , f.end()
+                  , [](const bulk_item_failure& _f) {
+                        return "document_missing_exception" == _f.type;
+                    })
+              , f.end());
+            return f;
+        };
+
+        std::vector<bulk_item_failure> failed;
+        std::vector<bulk_item_failure> pending;
+
+        try {
+            for(auto&& f : get_failures(_response.text)) {
+                (is_transient_status(f.status) ? pending : failed).push_back(std::move(f));
+            }
+        }
+        catch(const json::exception& _e) {
+            return ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("failed to parse bulk response for [{}] [{}]"
+                        , _logical_path
+                        , _e.what()));
+        }
+
+        const auto& cfg = _client.configuration();
+
+        // the body and offsets the pending failures refer to
+        std::string_view         body{_body};
+        std::vector<std::size_t> offsets = _offsets;
+        std::string              retry_body;
+
+        for(uint32_t attempt = 1; attempt <= cfg.bulk_retries && !pending.empty(); ++attempt) {
+            std::string                    next;
+            std::vector<std::size_t>       next_offsets;
+            std::vector<bulk_item_failure> sent;
+
+            for(auto&& f : pending) {
+                // a response naming an item the request did not hold
+                if(f.position >= offsets.size()) {
+                    failed.push_back(std::move(f));
+                    continue;
+                }
+
+                const auto begin = offsets[f.position];
+                const auto end   = f.position + 1 < offsets.size() ? offsets[f.position + 1] : body.size();
+
+                next_offsets.push_back(next.size());
+                next.append(body.substr(begin, end - begin));
+                sent.push_back(std::move(f));
+            }
+
+            pending = std::move(sent);
+            if(pending.empty()) {
+                break;
+            }
+
+            retry_body = std::move(next);
+            body       = retry_body;
+            offsets    = std::move(next_offsets);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds{
+                cfg.retry_backoff_ms * (1u << std::min(attempt - 1, 10u))});
+
+            span s{"bulk_retry"};
+            s.set("documents", offsets.size());
+            s.set("attempt",   attempt);
+
+            rodsLog(
+                LOG_NOTICE
+              , "retrying %d of %d bulk items for [%s] attempt [%u] reason [%s]"
+              , static_cast<int>(offsets.size())
+              , static_cast<int>(count)
+              , _logical_path.c_str()
+              , attempt
+              , pending.front().type.c_str());
+
+            cpr::Response r{};
+            try {
+                r = _client.performRequest(elasticlient::Client::HTTPMethod::POST, "_bulk", retry_body);
+            }
+            catch(const std::exception& _e) {
+                r.status_code = 0;
+                r.text        = _e.what();
+            }
+
+            s.set("http.status_code", r.status_code);
+
+            // the retry as a whole failed, its items are all still pending
+            if(200 != r.status_code) {
+                for(std::size_t i = 0; i < pending.size(); ++i) {
+                    pending[i].position = i;
+                    pending[i].status   = r.status_code;
+                    pending[i].reason   = r.text;
+                }
+
+                if(!is_transient_status(r.status_code)) {
+                    break;
+                }
+
+                continue;
+            }
+
+            pending.clear();
+
+            try {
+                for(auto&& f : get_failures(r.text)) {
+                    (is_transient_status(f.status) ? pending : failed).push_back(std::move(f));
+                }
+            }
+            catch(const json::exception& _e) {
+                return ERROR(
+                           SYS_INTERNAL_ERR,
+                           fmt::format("failed to parse bulk response for [{}] [{}]"
+                            , _logical_path
+                            , _e.what()));
+            }
+        } // for attempt
+
+        failed.insert(failed.end(), pending.begin(), pending.end());
+
+        if(failed.empty()) {
+            return SUCCESS();
+        }
+
+        // enough to act upon without flooding the log
+        constexpr std::size_t max_logged{10};
+
+        for(std::size_t i = 0; i < failed.size() && i < max_logged; ++i) {
+            const auto& f = failed[i];
+            rodsLog(
+                LOG_ERROR
+              , "bulk %s of [%s] in [%s] failed for [%s] status [%d] type [%s] reason [%s]"
+              , f.action.c_str()
+              , f.id.c_str()
+              , f.index.c_str()
+              , _logical_path.c_str()
+              , f.status
+              , f.type.c_str()
+              , f.reason.c_str());
+        }
+
+        return ERROR(
+                   SYS_INTERNAL_ERR,
+                   fmt::format("Encountered {} errors when indexing [{}] first [{}] [{}] [{}]"
+                    , failed.size()
+                    , _logical_path
+                    , failed.front().id
+                    , failed.front().status
+                    , failed.front().reason));
+
+    } // check_bulk_response
+
+    // accumulates index actions for any number of indices into a single
+    // _bulk request body, each action names its own target index.  given a
+    // daemon socket the body is handed to the local indexing daemon instead,
+    // falling back to elasticsearch should the daemon be unavailable.  with
+    // max_in_flight above one, bulks are sent asynchronously and the caller
+    // must flush to wait for them and collect their errors.  the body is
+    // cleared rather than released between bulks, so once it has grown to
+    // the size of a bulk adding documents no longer allocates.
+    class bulk_request {
+    public:
+        bulk_request(
+              std::shared_ptr<elasticsearch_client> _client
+            , const uint32_t                        _bulk_count
+            , const std::string&                    _daemon_socket = {}
+            , const qos_policy&                     _qos = {})
+            : client_{_client}
+            , bulk_count_{_bulk_count}
+            , daemon_socket_{_daemon_socket}
+            , qos_{_qos}
+        {
+            const auto& cfg = client_->configuration();
+            if(cfg.max_in_flight > 1) {
+                transport_ = std::make_unique<async_transport>(cfg, cfg.max_in_flight);
+            }
+        }
+
+        bulk_request(const bulk_request&) = delete;
+        bulk_request& operator=(const bulk_request&) = delete;
+
+        // returns true once bulk_count documents have been added
+        bool index_document(
+              const std::string& _index_name
+            , const std::string& _id
+            , const std::string& _document
+            , const std::string& _routing = {})
+        {
+            begin_document(_index_name, _id, _routing) += _document;
+
+            return end_document();
+
+        } // index_document
+
+        // writes the action line for a document and returns the body so the
+        // caller may write the document source directly after it, without
+        // building it elsewhere first.  end_document completes it.
+        std::string& begin_document(
+              const std::string& _index_name
+            , const std::string& _id
+            , const std::string& _routing = {})
+        {
+            add_action(_index_name, _id, _routing);
+
+            fmt::format_to(
+                std::back_inserter(body_)
+              , "{{\"index\":{{\"_index\":\"{}\",\"_type\":\"text\",\"_id\":\"{}\""
+              , _index_name
+              , _id);
+
+            if(!_routing.empty()) {
+                fmt::format_to(std::back_inserter(body_), ",\"routing\":\"{}\"", _routing);
+            }
+
+            body_ += "}}\n";
+
+            return body_;
+
+        } // begin_document
+
+        // returns true once bulk_count documents have been added
+        bool end_document()
+        {
+            body_ += '\n';
+
+            return ++size_ >= bulk_count_;
+
+        } // end_document
+
+        // returns true once bulk_count actions have been added
+        bool update_document(
+              const std::string& _index_name
+            , const std::string& _id
+            , const std::string& _update
+            , const std::string& _routing = {})
+        {
+            add_action(_index_name, _id, _routing);
+
+            fmt::format_to(
+                std::back_inserter(body_)
+              , "{{\"update\":{{\"_index\":\"{}\",\"_type\":\"text\",\"_id\":\"{}\",\"retry_on_conflict\":3"
+              , _index_name
+              , _id);
+
+            if(!_routing.empty()) {
+                fmt::format_to(std::back_inserter(body_), ",\"routing\":\"{}\"", _routing);
+            }
+
+            body_ += "}}\n";
+            body_ += _update;
+            body_ += '\n';
+
+            return ++size_ >= bulk_count_;
+
+        } // update_document
+
+        // returns true once bulk_count actions have been added
+        bool remove_document(
+              const std::string& _index_name
+            , const std::string& _id)
+        {
+            add_action(_index_name, _id);
+
+            fmt::format_to(
+                std::back_inserter(body_)
+              , "{{\"delete\":{{\"_index\":\"{}\",\"_type\":\"text\",\"_id\":\"{}\"}}}}\n"
+              , _index_name
+              , _id);
+
+            return ++size_ >= bulk_count_;
+
+        } // remove_document
+
+        auto size() const { return size_; }
+
+        auto empty() const { return 0 == size_; }
+
+        // whether any bulk was handed to the daemon, whose success says
+        // nothing of whether its items were applied
+        auto delegated() const { return delegated_; }
+
+        irods::error perform(const std::string& _logical_path)
+        {
+            if(empty()) {
+                return SUCCESS();
+            }
+
+            span s{"bulk_request"};
+            s.set("documents", size_);
+            s.set("bytes",     body_.size());
+
+            resolve_backing_indices();
+
+            qos_limiter::instance().throttle_send(qos_.config, qos_.priority, body_.size());
+
+            // a bulk too large for a single frame is sent directly
+            const auto fits_frame = body_.size() + sizeof(uint32_t) <= protocol::max_payload_size;
+
+            if(!daemon_socket_.empty() && !fits_frame) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "bulk of %llu bytes exceeds the indexing daemon frame size, sending directly for [%s]"
+                  , static_cast<unsigned long long>(body_.size())
+                  , _logical_path.c_str());
+            }
+
+            if(!daemon_socket_.empty() && fits_frame) {
+                s.set("destination", "daemon");
+
+                try {
+                    // written to the socket straight from the body
+                    daemon_client::instance(daemon_socket_).send(
+                        protocol::operation_type::bulk
+                      , {std::string_view{body_}});
+
+                    body_.clear();
+                    offsets_.clear();
+                    size_ = 0;
+                    delegated_ = true;
+
+                    return SUCCESS();
+                }
+                catch(const std::exception& _e) {
+                    rodsLog(
+                        LOG_NOTICE
+                      , "indexing daemon unavailable, sending directly for [%s] [%s]"
+                      , _logical_path.c_str()
+                      , _e.what());
+                    s.set_error(_e.what());
+                }
+            }
+
+            s.set("destination", "elasticsearch");
+
+            const auto count = size_;
+
+            if(!transport_) {
+                const cpr::Response response = client_->performRequest(
+                                                   elasticlient::Client::HTTPMethod::POST
+                                                 , "_bulk"
+                                                 , body_);
+                s.set("http.status_code", response.status_code);
+
+                auto err = check_bulk_response(*client_, response, body_, offsets_, _logical_path);
+
+                body_.clear();
+                offsets_.clear();
+                size_ = 0;
+
+                if(!err.ok()) {
+                    s.set_error(err.result());
+                }
+
+                return err;
+            }
+
+            size_ = 0;
+
+            // the items of the bulk are located within its body should any
+            // need to be sent again
+            auto offsets = std::move(offsets_);
+            offsets_ = std::vector<std::size_t>{};
+            offsets_.reserve(bulk_count_);
+
+            // the round trip is traced beneath this span once it completes
+            const auto context = current_trace_context();
+            const auto start   = trace::now_ns();
+
+            // the bulk is sent while the caller goes on to build the next,
+            // its result is reported by a later perform or by flush
+            transport_->submit(
+                elasticlient::Client::HTTPMethod::POST
+              , "_bulk"
+              , std::move(body_)
+              , [this, count, offsets = std::move(offsets), _logical_path, context, start](
+                    const cpr::Response&  _response
+                  , std::exception_ptr    _error
+                  , std::string&          _body
+                  , elasticsearch_client& _client) {
+                  trace_attachment attachment{context};
+                  span r{"bulk_response", start};
+                  r.set("http.status_code", _response.status_code);
+
+                  irods::error err = SUCCESS();
+
+                  try {
+                      if(_error) {
+                          std::rethrow_exception(_error);
+                      }
+
+                      // retried by the sender with its own client
+                      err = check_bulk_response(_client, _response, _body, offsets, _logical_path);
+                  }
+                  catch(const std::exception& _e) {
+                      err = ERROR(
+                                SYS_INTERNAL_ERR,
+                                fmt::format("bulk request of {} documents failed for [{}] [{}]"
+                                , count
+                                , _logical_path
+                                , _e.what()));
+                  }
+
+                  recycle(std::move(_body));
+
+                  if(!err.ok()) {
+                      rodsLog(LOG_ERROR, "%s", err.result().c_str());
+                      r.set_error(err.result());
+
+                      std::lock_guard lk{mutex_};
+                      last_error_ = err;
+                  }
+              });
+
+            // continue in a body which has already grown to a bulk's size
+            body_ = take_spare();
+
+            return take_error();
+
+        } // perform
+
+        // perform whatever remains and wait for every bulk still in flight,
+        // returning the last error of any of them
+        irods::error flush(const std::string& _logical_path)
+        {
+            auto err = perform(_logical_path);
+
+            if(transport_) {
+                transport_->wait();
+
+                auto last = take_error();
+                if(!last.ok()) {
+                    err = last;
+                }
+            }
+
+            return err;
+
+        } // flush
+
+    private:
+        // an action whose target is a rollover alias spanning several
+        // backing indices, any of which may already hold the document
+        struct aliased_action {
+            std::size_t position;
+            std::string alias;
+            std::string id;
+            std::string routing;
+        };
+
+        void add_action(
+              const std::string& _index_name
+            , const std::string& _id
+            , const std::string& _routing = {})
+        {
+            offsets_.push_back(body_.size());
+
+            // documents are mostly added to one index after another
+            if(_index_name != last_index_) {
+                last_index_ = _index_name;
+                last_spans_ = rollover_aliases::instance().spans_indices(*client_, _index_name);
+            }
+
+            if(last_spans_) {
+                aliased_.push_back({offsets_.size() - 1, _index_name, _id, _routing});
+            }
+
+        } // add_action
+
+        // direct the actions on documents which already exist in a backing
+        // index of their alias to that index rather than the write index,
+        // so that the document is replaced or updated where it lives
+        void resolve_backing_indices()
+        {
+            if(aliased_.empty()) {
+                return;
+            }
+
+            std::map<std::string, std::vector<std::pair<std::string, std::string>>> ids;
+            for(auto&& a : aliased_) {
+                ids[a.alias].emplace_back(a.id, a.routing);
+            }
+
+            std::map<std::string, std::map<std::string, std::string>> found;
+            for(auto&& [alias, alias_ids] : ids) {
+                try {
+                    found[alias] = rollover_aliases::instance().resolve(*client_, alias, alias_ids);
+                }
+                catch(const std::exception& _e) {
+                    // written through the alias, which may leave a duplicate
+                    rodsLog(LOG_ERROR, "%s", _e.what());
+                }
+            }
+
+            std::map<std::size_t, std::pair<std::string, std::string>> rewrites;
+            for(auto&& a : aliased_) {
+                auto& f  = found[a.alias];
+                auto  it = f.find(a.id);
+                if(it != f.end()) {
+                    rewrites[a.position] = {a.alias, it->second};
+                }
+            }
+
+            aliased_.clear();
+
+            if(rewrites.empty()) {
+                return;
+            }
+
+            const std::string_view   body{body_};
+            std::string              rewritten;
+            std::vector<std::size_t> offsets;
+
+            rewritten.reserve(body_.size() + rewrites.size() * 16);
+            offsets.reserve(offsets_.size());
+
+            for(std::size_t p = 0; p < offsets_.size(); ++p) {
+                const auto begin = offsets_[p];
+                const auto end   = p + 1 < offsets_.size() ? offsets_[p + 1] : body.size();
+                const auto item  = body.substr(begin, end - begin);
+
+                offsets.push_back(rewritten.size());
+
+                auto it = rewrites.find(p);
+                if(it == rewrites.end()) {
+                    rewritten.append(item);
+                    continue;
+                }
+
+                const auto from = fmt::format("\"_index\":\"{}\"", it->second.first);
+                const auto pos  = item.find(from);
+                if(std::string_view::npos == pos) {
+                    rewritten.append(item);
+                    continue;
+                }
+
+                rewritten.append(item.substr(0, pos));
+                fmt::format_to(std::back_inserter(rewritten), "\"_index\":\"{}\"", it->second.second);
+                rewritten.append(item.substr(pos + from.size()));
+            }
+
+            body_    = std::move(rewritten);
+            offsets_ = std::move(offsets);
+
+        } // resolve_backing_indices
+
+        irods::error take_error()
+        {
+            std::lock_guard lk{mutex_};
+
+            auto err = last_error_;
+            last_error_ = SUCCESS();
+
+            return err;
+
+        } // take_error
+
+        // keep the storage of a sent body for a later bulk
+        void recycle(std::string&& _body)
+        {
+            _body.clear();
+
+            std::lock_guard lk{mutex_};
+            spare_.push_back(std::move(_body));
+
+        } // recycle
+
+        std::string take_spare()
+        {
+            std::lock_guard lk{mutex_};
+
+            if(spare_.empty()) {
+                return {};
+            }
+
+            auto body = std::move(spare_.back());
+            spare_.pop_back();
+
+            return body;
+
+        } // take_spare
+
+        std::shared_ptr<elasticsearch_client> client_;
+        const uint32_t                        bulk_count_;
+        const std::string                     daemon_socket_;
+        const qos_policy                      qos_;
+        std::string                           body_;
+        // the start of each action within the body
+        std::vector<std::size_t>              offsets_;
+        std::vector<aliased_action>           aliased_;
+        std::string                           last_index_;
+        bool                                  last_spans_{};
+        bool                                  delegated_{};
+        uint32_t                              size_{};
+        std::mutex                            mutex_;
+        irods::error                          last_error_{SUCCESS()};
+        // bodies returned by completed bulks, at most max_in_flight of them
+        std::vector<std::string>              spare_;
+        // declared last so that bulks in flight complete before the
+        // members their callbacks use are destroyed
+        std::unique_ptr<async_transport>      transport_;
+
+    }; // class bulk_request
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_BULK_HPP
@@ -0,0 +1,468 @@
+#ifndef IRODS_INDEXING_BULK_LOAD_HPP
+#define IRODS_INDEXING_BULK_LOAD_HPP
+
+// index settings suited to a bulk load, held for the duration of a
+// collection backfill.  refreshes are disabled, and replicas optionally
+// dropped, when the first backfill of an index starts, and the original
+// settings are restored and the index refreshed once the last one ends.
+//
+// the backfills holding an index may run in different agents, so they are
+// counted in a document per index, named for it, in a small coordination
+// index and changed only by scripted updates.  each holder renews a lease
+// while it runs, the lease of an agent which exits without releasing the
+// index lapses and is discarded by the next backfill of that index.  the
+// original settings are recorded in the same document by the first holder.
+// the last holder removes the document only if it is unchanged since it was
+// found without holders, and otherwise puts back the settings of the load
+// which took the index meanwhile.
+
+#include "utilities.hpp"
+#include "host_selector.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+namespace irods::indexing {
+
+    const std::string bulk_load_index{"irods_indexing_bulk_load"};
+
+    struct bulk_load_configuration {
+        bool     enabled;
+        // replicas are dropped to zero, and rebuilt once the load ends
+        bool     drop_replicas;
+        // how long a holder keeps the index without renewing, it renews
+        // every third of that
+        uint64_t lease_ms;
+    };
+
+    auto get_bulk_load_configuration(const pe::configuration_manager& _cfg)
+    {
+        // clang-format off
+        return bulk_load_configuration{
+                   std::string{"true"} == _cfg.get("backfill_bulk_load",     std::string{"false"})
+                 , std::string{"true"} == _cfg.get("backfill_drop_replicas", std::string{"false"})
+                 , _cfg.get("backfill_lease_ms", uint64_t{600000})};
+        // clang-format on
+
+    } // get_bulk_load_configuration
+
+    // the coordination document of an index, with the sequence number and
+    // primary term of the version read
+    struct bulk_load_document {
+        bool    found{};
+        json    source{json::object()};
+        int64_t seq_no{-1};
+        int64_t primary_term{-1};
+
+        bool same_version(const bulk_load_document& _other) const
+        {
+            return found        == _other.found
+                && seq_no       == _other.seq_no
+                && primary_term == _other.primary_term;
+        }
+    };
+
+    class bulk_load {
+    public:
+        bulk_load(
+              elasticsearch_client&          _client
+            , const bulk_load_configuration& _config
+            , const std::string&             _index_name)
+            : client_{_client}
+            , config_{_config}
+            , index_name_{_index_name}
+            , holder_{make_holder_id()}
+        {
+            if(!config_.enabled) {
+                return;
+            }
+
+            // a failure leaves the index as it was, the backfill goes on
+            try {
+                acquire();
+                held_ = true;
+                renewal_ = std::thread{[this] { renew(); }};
+            }
+            catch(const std::exception& _e) {
+                rodsLog(
+                    LOG_ERROR
+                  , "failed to prepare [%s] for bulk load [%s]"
+                  , index_name_.c_str()
+                  , _e.what());
+            }
+        }
+
+        ~bulk_load()
+        {
+            if(!held_) {
+                return;
+            }
+
+            {
+                std::lock_guard lk{mutex_};
+                done_ = true;
+            }
+            cv_.notify_all();
+            renewal_.join();
+
+            try {
+                release();
+            }
+            catch(const std::exception& _e) {
+                rodsLog(
+                    LOG_ERROR
+                  , "failed to restore [%s] after bulk load [%s]"
+                  , index_name_.c_str()
+                  , _e.what());
+            }
+        }
+
+        bulk_load(const bulk_load&) = delete;
+        bulk_load& operator=(const bulk_load&) = delete;
+
+    private:
+        static std::string make_holder_id()
+        {
+            static std::atomic<uint64_t> sequence{};
+
+            char host[256]{};
+            ::gethostname(host, sizeof(host) - 1);
+
+            return fmt::format("{}:{}:{}", host, ::getpid(), sequence++);
+        }
+
+        static int64_t now_ms()
+        {
+            using namespace std::chrono;
+            return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        }
+
+        cpr::Response request(
+              const elasticlient::Client::HTTPMethod _method
+            , const std::string&                     _path
+            , const std::string&                     _body
+            , const std::string&                     _description)
+        {
+            cpr::Response r = client_.performRequest(_method, _path, _body);
+            if(r.status_code < 200 || r.status_code > 299) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("{} failed for [{}] code [{}] message [{}]"
+                    , _description
+                    , index_name_
+                    , r.status_code
+                    , r.text));
+            }
+
+            return r;
+
+        } // request
+
+        // apply a script to the coordination document of the index, which
+        // the script may create
+        void update_holders(const std::string& _script, const json& _params)
+        {
+            // clang-format off
+            static const std::string prune{
+                "if (ctx._source.holders == null) { ctx._source.holders = [:]; } "
+                "long now = params.now; "
+                "ctx._source.holders.values().removeIf(v -> v < now); "};
+            // clang-format on
+
+            auto params = _params;
+            params["holder"] = holder_;
+            params["now"]    = now_ms();
+
+            request(
+                elasticlient::Client::HTTPMethod::POST
+              , fmt::format("{}/text/{}/_update?retry_on_conflict=10", bulk_load_index, index_name_)
+              , json{
+                    {"scripted_upsert", true},
+                    {"upsert",          json::object()},
+                    {"script",          {
+                        {"lang",   "painless"},
+                        {"source", prune + _script},
+                        {"params", params}}}}.dump()
+              , "bulk load update");
+
+        } // update_holders
+
+        bulk_load_document get_holders()
+        {
+            cpr::Response r = client_.performRequest(
+                                  elasticlient::Client::HTTPMethod::GET
+                                , fmt::format("{}/text/{}", bulk_load_index, index_name_)
+                                , "");
+            if(404 == r.status_code) {
+                return bulk_load_document{};
+            }
+
+            if(200 != r.status_code) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to get bulk load holders of [{}] code [{}] message [{}]"
+                    , index_name_
+                    , r.status_code
+                    , r.text));
+            }
+
+            const auto response = json::parse(r.text);
+
+            return bulk_load_document{
+                       true
+                     , response.value("_source",       json::object())
+                     , response.value("_seq_no",       int64_t{-1})
+                     , response.value("_primary_term", int64_t{-1})};
+
+        } // get_holders
+
+        // remove the coordination document only while it is still the
+        // version which was read, false should it have changed meanwhile
+        bool remove_holders(const bulk_load_document& _doc)
+        {
+            cpr::Response r = client_.performRequest(
+                                  elasticlient::Client::HTTPMethod::DELETE
+                                , fmt::format("{}/text/{}?if_seq_no={}&if_primary_term={}"
+                                  , bulk_load_index
+                                  , index_name_
+                                  , _doc.seq_no
+                                  , _doc.primary_term)
+                                , "");
+            if(409 == r.status_code || 404 == r.status_code) {
+                return false;
+            }
+
+            if(r.status_code < 200 || r.status_code > 299) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to remove bulk load holders of [{}] code [{}] message [{}]"
+                    , index_name_
+                    , r.status_code
+                    , r.text));
+            }
+
+            return true;
+
+        } // remove_holders
+
+        // the refresh interval and replicas set on the index, a refresh
+        // interval left to its default is null
+        json get_settings()
+        {
+            cpr::Response r = client_.performRequest(
+                                  elasticlient::Client::HTTPMethod::GET
+                                , fmt::format("{}/_settings?flat_settings=true", index_name_)
+                                , "");
+
+            // the index is created ahead of the load, from its template
+            // should there be one, so that its settings may be changed
+            if(404 == r.status_code) {
+                request(elasticlient::Client::HTTPMethod::PUT, index_name_, "", "index creation");
+                r = request(
+                        elasticlient::Client::HTTPMethod::GET
+                      , fmt::format("{}/_settings?flat_settings=true", index_name_)
+                      , ""
+                      , "get settings");
+            }
+            else if(200 != r.status_code) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to get settings of [{}] code [{}] message [{}]"
+                    , index_name_
+                    , r.status_code
+                    , r.text));
+            }
+
+            // an alias names its backing index rather than itself
+            const auto response = json::parse(r.text);
+            if(response.empty()) {
+                THROW(SYS_INTERNAL_ERR, fmt::format("no settings returned for [{}]", index_name_));
+            }
+
+            const auto& settings = response.begin()->at("settings");
+
+            // a disabled refresh can only have been left by a load which
+            // did not finish, the default is restored in its place
+            auto refresh = settings.value("index.refresh_interval", json{});
+            if(refresh.is_string() && "-1" == refresh.get<std::string>()) {
+                refresh = json{};
+            }
+
+            return json{
+                {"refresh_interval",   refresh},
+                {"number_of_replicas", settings.value("index.number_of_replicas", json{})}};
+
+        } // get_settings
+
+        void put_settings(const json& _settings)
+        {
+            request(
+                elasticlient::Client::HTTPMethod::PUT
+              , fmt::format("{}/_settings", index_name_)
+              , json{{"index", _settings}}.dump()
+              , "put settings");
+        }
+
+        static json make_load_settings(const bool _drop_replicas)
+        {
+            auto settings = json{{"refresh_interval", "-1"}};
+            if(_drop_replicas) {
+                settings["number_of_replicas"] = 0;
+            }
+
+            return settings;
+        }
+
+        // take or renew the index, recording whether replicas are dropped so
+        // that a release may put the settings of the load back
+        void hold()
+        {
+            update_holders(
+                "ctx._source.holders[params.holder] = params.expires; "
+                "if (params.drop_replicas) { ctx._source.drop_replicas = true; }"
+              , json{
+                    {"expires",       now_ms() + static_cast<int64_t>(config_.lease_ms)},
+                    {"drop_replicas", config_.drop_replicas}});
+        }
+
+        void acquire()
+        {
+            hold();
+
+            // the first holder records the settings to be restored.  a
+            // holder which finds none recorded reads them only after it
+            // holds the index, so no release may restore them meanwhile.
+            if(!get_holders().source.contains("original")) {
+                update_holders(
+                    "if (ctx._source.original == null) { ctx._source.original = params.original; } else { ctx.op = 'noop'; }"
+                  , json{{"original", get_settings()}});
+            }
+
+            put_settings(make_load_settings(config_.drop_replicas));
+
+            rodsLog(
+                LOG_NOTICE
+              , "prepared [%s] for bulk load as [%s]"
+              , index_name_.c_str()
+              , holder_.c_str());
+
+        } // acquire
+
+        void renew()
+        {
+            const auto interval = std::chrono::milliseconds{std::max<uint64_t>(1, config_.lease_ms / 3)};
+
+            std::unique_lock lk{mutex_};
+            while(!cv_.wait_for(lk, interval, [this] { return done_; })) {
+                try {
+                    hold();
+                }
+                catch(const std::exception& _e) {
+                    rodsLog(
+                        LOG_ERROR
+                      , "failed to renew bulk load of [%s] [%s]"
+                      , index_name_.c_str()
+                      , _e.what());
+                }
+            }
+
+        } // renew
+
+        void release()
+        {
+            update_holders("ctx._source.holders.remove(params.holder);", json::object());
+
+            // the documents of this backfill become visible even while other
+            // backfills keep refreshes disabled
+            request(
+                elasticlient::Client::HTTPMethod::POST
+              , fmt::format("{}/_refresh", index_name_)
+              , ""
+              , "refresh");
+
+            // another backfill may take the index between reading the
+            // document and restoring the settings, which would then be lost
+            // to it.  the settings are brought in line with the document
+            // until it is found unchanged afterwards.
+            json original{};
+            bool restored{};
+
+            for(int attempt = 0; attempt < 10; ++attempt) {
+                const auto doc = get_holders();
+                original = doc.source.value("original", original);
+
+                const auto holders = doc.source.value("holders", json::object());
+
+                if(!holders.empty()) {
+                    // the remaining holders keep the settings as they are
+                    if(!restored) {
+                        rodsLog(
+                            LOG_NOTICE
+                          , "[%s] still held for bulk load by %d other backfills"
+                          , index_name_.c_str()
+                          , static_cast<int>(holders.size()));
+                        return;
+                    }
+
+                    // taken after the settings were restored, put them back
+                    put_settings(make_load_settings(doc.source.value("drop_replicas", false)));
+                }
+                else {
+                    if(original.is_object()) {
+                        put_settings(original);
+                    }
+                    restored = true;
+
+                    // a backfill which takes the index once the document is
+                    // gone records the settings which were just restored
+                    if(doc.found && remove_holders(doc)) {
+                        rodsLog(
+                            LOG_NOTICE
+                          , "restored [%s] after bulk load [%s]"
+                          , index_name_.c_str()
+                          , original.dump().c_str());
+                        return;
+                    }
+                }
+
+                if(get_holders().same_version(doc)) {
+                    rodsLog(
+                        LOG_NOTICE
+                      , "settings of [%s] match its bulk load holders after release"
+                      , index_name_.c_str());
+                    return;
+                }
+            } // for attempt
+
+            THROW(
+                SYS_INTERNAL_ERR,
+                fmt::format("settings of [{}] were changed by other backfills throughout the release", index_name_));
+
+        } // release
+
+        elasticsearch_client&   client_;
+        bulk_load_configuration config_;
+        std::string             index_name_;
+        std::string             holder_;
+        bool                    held_{};
+
+        std::mutex              mutex_;
+        std::condition_variable cv_;
+        bool                    done_{};
+        std::thread             renewal_;
+
+    }; // class bulk_load
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_BULK_LOAD_HPP
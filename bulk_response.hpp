@@ -0,0 +1,240 @@
+#ifndef IRODS_INDEXING_BULK_RESPONSE_HPP
+#define IRODS_INDEXING_BULK_RESPONSE_HPP
+
+// reading of _bulk responses, shared by the policy plugins and the indexing
+// daemon and kept free of irods headers.
+//
+// a bulk response echoes every item of its request, though only the failed
+// ones are of interest.  the errors flag leading the response is checked
+// first, so a bulk without errors is never parsed.  otherwise the response
+// is parsed as a stream of events, without building a document, keeping
+// only the position, id, status and reason of each failed item.
+
+#include "json.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace irods::indexing {
+
+    struct bulk_item_failure {
+        // of the item within the request, and so of its action
+        std::size_t position{};
+        std::string action;
+        std::string index;
+        std::string id;
+        int         status{};
+        std::string type;
+        std::string reason;
+    };
+
+    // statuses after which an item may succeed if it is sent again
+    inline bool is_transient_status(const int _status)
+    {
+        return 0 == _status || 429 == _status || _status >= 500;
+    }
+
+    // false only when the response declares that no item failed.  the flag
+    // precedes the items, so only the start of the response is searched.
+    inline bool bulk_response_has_errors(std::string_view _text)
+    {
+        const auto items = _text.find("\"items\"");
+        const auto head  = _text.substr(0, items);
+
+        const auto key = head.find("\"errors\"");
+        if(std::string_view::npos == key) {
+            return true;
+        }
+
+        auto pos = head.find_first_not_of(" \t\r\n:", key + 8);
+        if(std::string_view::npos == pos) {
+            return true;
+        }
+
+        return head.substr(pos, 5) != "false";
+
+    } // bulk_response_has_errors
+
+    namespace detail {
+
+        // events of the parse of a bulk response, holding on to failed items.
+        // depth 1 is the response, 2 the items, 3 an item, 4 its action and
+        // 5 the error of the action.
+        class bulk_failure_collector {
+        public:
+            using json = nlohmann::json;
+
+            explicit bulk_failure_collector(std::vector<bulk_item_failure>& _failures)
+                : failures_{_failures}
+            {
+            }
+
+            bool null() { return true; }
+
+            bool boolean(bool) { return true; }
+
+            bool number_integer(json::number_integer_t _v)
+            {
+                number(static_cast<int>(_v));
+                return true;
+            }
+
+            bool number_unsigned(json::number_unsigned_t _v)
+            {
+                number(static_cast<int>(_v));
+                return true;
+            }
+
+            bool number_float(json::number_float_t, const json::string_t&) { return true; }
+
+            bool string(json::string_t& _v)
+            {
+                if(4 == depth_ && in_items_) {
+                    if("_index" == key_) {
+                        item_.index = std::move(_v);
+                    }
+                    else if("_id" == key_) {
+                        item_.id = std::move(_v);
+                    }
+                    else if("error" == key_) {
+                        // older versions report the error as a string
+                        failed_      = true;
+                        item_.reason = std::move(_v);
+                    }
+                }
+                else if(5 == depth_ && in_error_) {
+                    if("type" == key_) {
+                        item_.type = std::move(_v);
+                    }
+                    else if("reason" == key_) {
+                        item_.reason = std::move(_v);
+                    }
+                }
+
+                return true;
+
+            } // string
+
+            // not produced when parsing json text
+            template <typename Binary>
+            bool binary(Binary&) { return true; }
+
+            bool start_object(std::size_t)
+            {
+                ++depth_;
+
+                if(3 == depth_ && in_items_) {
+                    item_   = bulk_item_failure{};
+                    failed_ = false;
+                    item_.position = position_++;
+                }
+                else if(5 == depth_ && in_items_ && "error" == key_) {
+                    failed_   = true;
+                    in_error_ = true;
+                }
+
+                return true;
+
+            } // start_object
+
+            bool end_object()
+            {
+                if(5 == depth_) {
+                    in_error_ = false;
+                }
+                else if(3 == depth_ && in_items_ && failed_) {
+                    failures_.push_back(std::move(item_));
+                }
+
+                --depth_;
+
+                return true;
+
+            } // end_object
+
+            bool start_array(std::size_t)
+            {
+                ++depth_;
+
+                if(2 == depth_ && "items" == key_) {
+                    in_items_ = true;
+                }
+
+                return true;
+
+            } // start_array
+
+            bool end_array()
+            {
+                if(2 == depth_) {
+                    in_items_ = false;
+                }
+
+                --depth_;
+
+                return true;
+
+            } // end_array
+
+            bool key(json::string_t& _k)
+            {
+                // the action names the single member of an item
+                if(3 == depth_ && in_items_) {
+                    item_.action = _k;
+                }
+
+                key_ = std::move(_k);
+
+                return true;
+
+            } // key
+
+            bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& _e)
+            {
+                throw _e;
+            }
+
+        private:
+            void number(const int _v)
+            {
+                if(4 == depth_ && in_items_ && "status" == key_) {
+                    item_.status = _v;
+                }
+            }
+
+            std::vector<bulk_item_failure>& failures_;
+            bulk_item_failure               item_;
+            std::string                     key_;
+            std::size_t                     depth_{};
+            std::size_t                     position_{};
+            bool                            in_items_{};
+            bool                            in_error_{};
+            bool                            failed_{};
+
+        }; // class bulk_failure_collector
+
+    } // namespace detail
+
+    // the failed items of a bulk response, throwing a json exception should
+    // the response not be valid json
+    inline std::vector<bulk_item_failure> get_bulk_failures(std::string_view _text)
+    {
+        std::vector<bulk_item_failure> failures;
+
+        if(!bulk_response_has_errors(_text)) {
+            return failures;
+        }
+
+        detail::bulk_failure_collector collector{failures};
+        nlohmann::json::sax_parse(_text.data(), _text.data() + _text.size(), &collector);
+
+        return failures;
+
+    } // get_bulk_failures
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_BULK_RESPONSE_HPP
@@ -0,0 +1,285 @@
+#ifndef IRODS_INDEXING_CHECKPOINT_HPP
+#define IRODS_INDEXING_CHECKPOINT_HPP
+
+#include "utilities.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace irods::indexing {
+
+    const std::string checkpoint_attribute{"irods::indexing::checkpoint"};
+
+    namespace checkpoint_store {
+        const std::string none{"none"};
+        const std::string file{"file"};
+        const std::string avu{"avu"};
+    }
+
+    struct checkpoint_configuration {
+        std::string store;
+        std::string directory;
+        uint64_t    interval;
+    };
+
+    auto get_checkpoint_configuration(const pe::configuration_manager& _cfg)
+    {
+        // clang-format off
+        auto c = checkpoint_configuration{
+                     _cfg.get("checkpoint_store",     checkpoint_store::file)
+                   , _cfg.get("checkpoint_directory", std::string{"/var/lib/irods/indexing_checkpoints"})
+                   , _cfg.get("checkpoint_interval",  uint64_t{10000})};
+        // clang-format on
+
+        if(checkpoint_store::none != c.store
+           && checkpoint_store::file != c.store
+           && checkpoint_store::avu  != c.store) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid checkpoint_store [{}]", c.store));
+        }
+
+        return c;
+
+    } // get_checkpoint_configuration
+
+    // persists the progress cursor of a backfill, the largest DATA_ID below
+    // which every object has been processed, either to a local state file
+    // or as an avu on the collection being backfilled.  a checkpoint is
+    // keyed on the collection, index name and index type.
+    class checkpoint {
+    public:
+        checkpoint(
+              rsComm_t*                       _comm
+            , const checkpoint_configuration& _config
+            , const std::string&              _collection
+            , const std::string&              _index_name
+            , const std::string&              _index_type)
+            : comm_{_comm}
+            , config_{_config}
+            , collection_{_collection}
+            , key_{_index_name + indexer_separator + _index_type}
+        {
+        }
+
+        auto enabled() const { return checkpoint_store::none != config_.store; }
+
+        auto interval() const { return config_.interval; }
+
+        std::string load() const
+        {
+            if(checkpoint_store::file == config_.store) {
+                std::ifstream in{file_path()};
+                if(!in) {
+                    return {};
+                }
+
+                try {
+                    const auto j = json::parse(in);
+                    if(j.at("collection") == collection_ && j.at("key") == key_) {
+                        return j.at("cursor").get<std::string>();
+                    }
+                }
+                catch(const json::exception& _e) {
+                    rodsLog(
+                        LOG_ERROR
+                      , "ignoring invalid checkpoint [%s] [%s]"
+                      , file_path().c_str()
+                      , _e.what());
+                }
+
+                return {};
+            }
+
+            if(checkpoint_store::avu == config_.store) {
+                for(auto&& avu : fsvr::get_metadata(*comm_, collection_)) {
+                    if(checkpoint_attribute == avu.attribute && key_ == avu.value) {
+                        return avu.units;
+                    }
+                }
+            }
+
+            return {};
+
+        } // load
+
+        void save(const std::string& _cursor) const
+        {
+            if(checkpoint_store::file == config_.store) {
+                ::mkdir(config_.directory.c_str(), S_IRWXU);
+
+                const auto path = file_path();
+                const auto temp = path + ".tmp";
+                {
+                    std::ofstream out{temp, std::ios::trunc};
+                    out << json{{"collection", collection_}, {"key", key_}, {"cursor", _cursor}}.dump();
+                    if(!out) {
+                        THROW(
+                            FILE_OPEN_ERR,
+                            fmt::format("failed to write checkpoint [{}]", temp));
+                    }
+                }
+
+                std::rename(temp.c_str(), path.c_str());
+            }
+            else if(checkpoint_store::avu == config_.store) {
+                std::lock_guard lk{connection_mutex(comm_)};
+                remove_avus();
+                fsvr::add_metadata(*comm_, collection_, {checkpoint_attribute, key_, _cursor});
+            }
+
+        } // save
+
+        void clear() const
+        {
+            if(checkpoint_store::file == config_.store) {
+                std::remove(file_path().c_str());
+            }
+            else if(checkpoint_store::avu == config_.store) {
+                std::lock_guard lk{connection_mutex(comm_)};
+                remove_avus();
+            }
+
+        } // clear
+
+    private:
+        std::string file_path() const
+        {
+            irods::Hasher hasher;
+            irods::getHasher(irods::MD5_NAME, hasher);
+            hasher.update(collection_ + key_);
+
+            std::string digest;
+            hasher.digest(digest);
+
+            return fmt::format("{}/{}.json", config_.directory, digest);
+
+        } // file_path
+
+        void remove_avus() const
+        {
+            for(auto&& avu : fsvr::get_metadata(*comm_, collection_)) {
+                if(checkpoint_attribute == avu.attribute && key_ == avu.value) {
+                    fsvr::remove_metadata(*comm_, collection_, avu);
+                }
+            }
+
+        } // remove_avus
+
+        rsComm_t*                      comm_;
+        const checkpoint_configuration config_;
+        const std::string              collection_;
+        const std::string              key_;
+
+    }; // class checkpoint
+
+    // errors are logged, a stale checkpoint only costs a rerun of its objects
+    void remove_checkpoint(const checkpoint& _checkpoint)
+    {
+        if(!_checkpoint.enabled()) {
+            return;
+        }
+
+        try {
+            _checkpoint.clear();
+        }
+        catch(const irods::exception& _e) {
+            rodsLog(LOG_ERROR, "failed to clear checkpoint [%s]", _e.what());
+        }
+
+    } // remove_checkpoint
+
+    // batches complete out of order on the thread pool, the cursor may only
+    // advance over a contiguous run of completed batches.  the checkpoint is
+    // saved every interval objects.
+    class checkpoint_tracker {
+    public:
+        explicit checkpoint_tracker(const checkpoint& _checkpoint)
+            : checkpoint_{_checkpoint}
+        {
+        }
+
+        // called by the producer in traversal order
+        uint64_t next_sequence() { return issued_++; }
+
+        // a batch with failed objects holds the cursor before it for the rest
+        // of the run, so that resuming the run retries those objects
+        void complete(
+              const uint64_t     _sequence
+            , const std::string& _last_id
+            , const uint64_t     _objects
+            , const uint64_t     _failed)
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+
+            if(_failed > 0) {
+                failed_ = std::min(failed_, _sequence);
+            }
+
+            completed_[_sequence] = _last_id;
+            unsaved_ += _objects;
+
+            for(auto it = completed_.find(next_);
+                it != completed_.end() && next_ < failed_;
+                it = completed_.find(next_)) {
+                cursor_ = it->second;
+                completed_.erase(it);
+                ++next_;
+            }
+
+            if(checkpoint_.enabled() && unsaved_ >= checkpoint_.interval()) {
+                save();
+            }
+
+        } // complete
+
+        // persist whatever progress has been made, used when a run aborts or
+        // completes with errors
+        void flush()
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+            if(checkpoint_.enabled() && unsaved_ > 0) {
+                save();
+            }
+
+        } // flush
+
+    private:
+        void save()
+        {
+            if(cursor_.empty()) {
+                return;
+            }
+
+            try {
+                checkpoint_.save(cursor_);
+                unsaved_ = 0;
+            }
+            catch(const irods::exception& _e) {
+                rodsLog(LOG_ERROR, "failed to save checkpoint [%s]", _e.what());
+            }
+
+        } // save
+
+        const checkpoint&                  checkpoint_;
+        std::mutex                         mutex_;
+        std::map<uint64_t, std::string>    completed_;
+        std::string                        cursor_;
+        uint64_t                           issued_{};
+        uint64_t                           next_{};
+        uint64_t                           unsaved_{};
+        uint64_t                           failed_{std::numeric_limits<uint64_t>::max()};
+
+    }; // class checkpoint_tracker
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_CHECKPOINT_HPP
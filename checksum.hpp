@@ -0,0 +1,531 @@
+#ifndef IRODS_INDEXING_CHECKSUM_HPP
+#define IRODS_INDEXING_CHECKSUM_HPP
+
+#include "utilities.hpp"
+#include "bulk.hpp"
+#include "query_task.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include "transport/default_transport.hpp"
+#include "dstream.hpp"
+
+#include "SHA256Strategy.hpp"
+
+#include <map>
+#include <vector>
+
+namespace irods::indexing {
+
+    namespace checksum_mode {
+        // never compare content, always index
+        const std::string none{"none"};
+        // compare the catalog checksum when one is present
+        const std::string catalog{"catalog"};
+        // compare the catalog checksum, computing a digest when it is missing
+        const std::string compute{"compute"};
+    }
+
+    auto get_checksum_mode(const pe::configuration_manager& _cfg)
+    {
+        auto m = _cfg.get("checksum_mode", checksum_mode::catalog);
+
+        if(checksum_mode::none != m
+           && checksum_mode::catalog != m
+           && checksum_mode::compute != m) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid checksum_mode [{}]", m));
+        }
+
+        return m;
+
+    } // get_checksum_mode
+
+    // prefer the checksum of a good replica, any replica will do otherwise
+    auto get_checksum_for_logical_path(
+          rsComm_t*          _comm
+        , const std::string& _logical_path)
+    {
+        fs::path p{_logical_path};
+
+        const auto qstr = fmt::format(
+            "SELECT DATA_CHECKSUM, DATA_REPL_STATUS WHERE DATA_NAME = '{}' AND COLL_NAME = '{}'"
+            , p.object_name().string()
+            , p.parent_path().string());
+
+        span s{"catalog_query"};
+        s.set("db.statement", qstr);
+
+        std::string checksum{};
+        for(const auto& row : irods::query<rsComm_t>{_comm, qstr}) {
+            if(row[0].empty()) {
+                continue;
+            }
+
+            if("1" == row[1]) {
+                return row[0];
+            }
+
+            checksum = row[0];
+        }
+
+        return checksum;
+
+    } // get_checksum_for_logical_path
+
+    // reads an object over a connection which may be shared by the threads
+    // of a backfill.  the stream is opened, read and closed while holding the
+    // connection, which is released between reads.
+    class object_reader {
+    public:
+        object_reader(
+              rsComm_t*          _comm
+            , const std::string& _logical_path)
+            : lock_{connection_mutex(_comm)}
+            , xport_{*_comm}
+            , stream_{xport_, _logical_path}
+        {
+            lock_.unlock();
+        }
+
+        ~object_reader()
+        {
+            // the stream is closed once the body has run
+            lock_.lock();
+        }
+
+        object_reader(const object_reader&) = delete;
+        object_reader& operator=(const object_reader&) = delete;
+
+        explicit operator bool() const
+        {
+            return static_cast<bool>(stream_);
+        }
+
+        // the number of bytes read
+        std::streamsize read(char* _buffer, const std::streamsize _size)
+        {
+            lock_.lock();
+            stream_.read(_buffer, _size);
+            const auto count = stream_.gcount();
+            lock_.unlock();
+
+            return count;
+
+        } // read
+
+    private:
+        std::unique_lock<std::mutex>                           lock_;
+        irods::experimental::io::server::basic_transport<char> xport_;
+        irods::experimental::io::idstream                      stream_;
+
+    }; // class object_reader
+
+    // a sha256 digest in the same form as an irods checksum so that it may
+    // be compared with catalog checksums of other objects.  the content is
+    // kept while it fits within keep bytes, so that an object found to have
+    // changed may be indexed without reading it again.
+    auto compute_checksum(
+          rsComm_t*          _comm
+        , const std::string& _logical_path
+        , const uint64_t     _read_size
+        , const qos_policy&  _qos
+        , std::string&       _content
+        , const uint64_t     _keep_bytes)
+    {
+        span s{"compute_checksum"};
+        s.set("logical_path", _logical_path);
+
+        irods::Hasher hasher;
+        irods::getHasher(irods::SHA256_NAME, hasher);
+
+        uint64_t bytes{};
+        int64_t  throttle_ns{};
+
+        std::string buffer(_read_size, '\0');
+        object_reader reader{_comm, _logical_path};
+
+        while(reader) {
+            const auto count = reader.read(buffer.data(), _read_size);
+            if(count <= 0) {
+                break;
+            }
+
+            const auto start = trace::now_ns();
+            qos_limiter::instance().throttle_read(_qos.config, _qos.priority, count);
+            throttle_ns += trace::now_ns() - start;
+            bytes += count;
+
+            hasher.update(std::string{buffer.data(), static_cast<std::size_t>(count)});
+
+            if(bytes <= _keep_bytes) {
+                _content.append(buffer.data(), count);
+            }
+        }
+
+        if(bytes > _keep_bytes) {
+            std::string{}.swap(_content);
+        }
+
+        std::string digest;
+        hasher.digest(digest);
+
+        s.set("bytes",       bytes);
+        s.set("throttle_ms", throttle_ns / 1000000);
+
+        return digest;
+
+    } // compute_checksum
+
+    // the checksum recorded with the first chunk of each object in each of
+    // the indices, fetched with a single multi get.  a rollover alias over
+    // several indices can not be read by id, and is searched instead.  keyed
+    // by index name and object id, objects not yet indexed are absent.
+    auto get_indexed_checksums(
+          elasticsearch_client&           _client
+        , const std::vector<std::string>& _index_names
+        , const std::vector<std::string>& _object_ids
+        , const bool                      _route_by_object_id)
+    {
+        std::map<std::pair<std::string, std::string>, std::string> checksums;
+
+        if(_object_ids.empty()) {
+            return checksums;
+        }
+
+        const auto add_checksum = [&checksums](const std::string& _index_name, const json& _doc) {
+            if(!_doc.contains("_source") || !_doc.at("_source").contains("checksum")) {
+                return;
+            }
+
+            const auto id  = _doc.at("_id").get<std::string>();
+            const auto pos = id.rfind(indexer_separator);
+            checksums[{_index_name, id.substr(0, pos)}] =
+                _doc.at("_source").at("checksum").get<std::string>();
+        };
+
+        span s{"indexed_checksums"};
+
+        // the index of each requested document, in the order of the docs
+        std::vector<std::string> requested;
+        auto docs = json::array();
+
+        for(auto&& index_name : _index_names) {
+            if(rollover_aliases::instance().spans_indices(_client, index_name)) {
+                auto ids = json::array();
+                for(auto&& id : _object_ids) {
+                    ids.push_back(id + indexer_separator + "0");
+                }
+
+                const cpr::Response response = _client.performRequest(
+                                                   elasticlient::Client::HTTPMethod::POST
+                                                 , index_name + "/_search"
+                                                 , json{
+                                                       {"size",    ids.size()},
+                                                       {"_source", json::array({"checksum"})},
+                                                       {"query",   {{"ids", {{"values", ids}}}}}}.dump());
+                if(response.status_code != 200) {
+                    rodsLog(
+                        LOG_ERROR
+                      , "failed to search indexed checksums of [%s] code [%d] message [%s]"
+                      , index_name.c_str()
+                      , static_cast<int>(response.status_code)
+                      , response.text.c_str());
+                    continue;
+                }
+
+                try {
+                    for(auto&& h : json::parse(response.text).at("hits").at("hits")) {
+                        add_checksum(index_name, h);
+                    }
+                }
+                catch(const json::exception& _e) {
+                    rodsLog(LOG_ERROR, "failed to parse indexed checksums [%s]", _e.what());
+                }
+
+                continue;
+            }
+
+            for(auto&& id : _object_ids) {
+                json doc{
+                    {"_index",  index_name},
+                    {"_type",   "text"},
+                    {"_id",     id + indexer_separator + "0"},
+                    {"_source", json::array({"checksum"})}};
+
+                // a routed chunk is only found on the shard of its object
+                if(_route_by_object_id) {
+                    doc["routing"] = id;
+                }
+
+                docs.push_back(doc);
+                requested.push_back(index_name);
+            }
+        }
+
+        if(docs.empty()) {
+            return checksums;
+        }
+
+        s.set("documents", docs.size());
+
+        const cpr::Response response = _client.performRequest(
+                                           elasticlient::Client::HTTPMethod::POST
+                                         , "_mget"
+                                         , json{{"docs", docs}}.dump());
+        s.set("http.status_code", response.status_code);
+        if(response.status_code != 200) {
+            s.set_error(response.text);
+            rodsLog(
+                LOG_ERROR
+              , "failed to fetch indexed checksums code [%d] message [%s]"
+              , static_cast<int>(response.status_code)
+              , response.text.c_str());
+            return checksums;
+        }
+
+        try {
+            // an alias is answered with the name of its index, the docs
+            // are matched to the requested names by position instead
+            const auto found = json::parse(response.text).at("docs");
+            for(std::size_t i = 0; i < found.size() && i < requested.size(); ++i) {
+                if(found[i].value("found", false)) {
+                    add_checksum(requested[i], found[i]);
+                }
+            }
+        }
+        catch(const json::exception& _e) {
+            rodsLog(LOG_ERROR, "failed to parse indexed checksums [%s]", _e.what());
+        }
+
+        return checksums;
+
+    } // get_indexed_checksums
+
+    // the checksum of the content of an object in one of the indices
+    struct object_checksum {
+        std::string index_name;
+        std::string object_id;
+        std::string checksum;
+    };
+
+    // another object holding the same content as each of the objects, found
+    // with a single multi search over every index.  the value is the id of
+    // the source object, keyed by index name and object id.  objects with
+    // no duplicate are absent.
+    auto find_duplicate_sources(
+          elasticsearch_client&               _client
+        , const std::vector<object_checksum>& _wanted)
+    {
+        std::map<std::pair<std::string, std::string>, std::string> sources;
+
+        if(_wanted.empty()) {
+            return sources;
+        }
+
+        span s{"find_duplicate_sources"};
+        s.set("documents", _wanted.size());
+
+        std::string body;
+        for(auto&& w : _wanted) {
+            auto query = json::object();
+            query["bool"]["must"] = json::array({
+                json{{"match", {{"checksum", {{"query", w.checksum}, {"operator", "and"}}}}}},
+                json{{"term",  {{"chunk", 0}}}}});
+            query["bool"]["must_not"] = json::array({
+                json{{"term", {{"object_id", std::stoull(w.object_id)}}}}});
+
+            // any object may hold the same content, so every shard is searched
+            body += json{{"index", w.index_name}}.dump() + '\n';
+            body += json{
+                        {"size",    1},
+                        {"_source", json::array({"object_id", "checksum"})},
+                        {"query",   query}}.dump() + '\n';
+        }
+
+        const cpr::Response response = _client.performRequest(
+                                           elasticlient::Client::HTTPMethod::POST
+                                         , "_msearch"
+                                         , body);
+        s.set("http.status_code", response.status_code);
+        if(response.status_code != 200) {
+            s.set_error(response.text);
+            rodsLog(
+                LOG_ERROR
+              , "failed to search for duplicate content code [%d] message [%s]"
+              , static_cast<int>(response.status_code)
+              , response.text.c_str());
+            return sources;
+        }
+
+        try {
+            // answered in the order of the searches
+            const auto responses = json::parse(response.text).at("responses");
+            for(std::size_t i = 0; i < responses.size() && i < _wanted.size(); ++i) {
+                if(!responses[i].contains("hits")) {
+                    continue;
+                }
+
+                const auto& hits = responses[i].at("hits").at("hits");
+                const auto& w    = _wanted[i];
+                if(hits.empty()
+                   || w.checksum != hits[0].at("_source").value("checksum", std::string{})) {
+                    continue;
+                }
+
+                sources[{w.index_name, w.object_id}] =
+                    std::to_string(hits[0].at("_source").at("object_id").get<uint64_t>());
+            }
+        }
+        catch(const json::exception& _e) {
+            rodsLog(LOG_ERROR, "failed to parse duplicate content [%s]", _e.what());
+        }
+
+        s.set("found", sources.size());
+
+        return sources;
+
+    } // find_duplicate_sources
+
+    // copy the chunk documents of an object holding the same content for
+    // this object, rather than reading and sanitizing the content again.
+    // returns false if no copy was made.
+    auto copy_duplicate_chunks(
+          elasticsearch_client& _client
+        , bulk_request&         _bulk
+        , const uint32_t        _page_size
+        , const std::string&    _index_name
+        , const std::string&    _object_id
+        , const std::string&    _logical_path
+        , const std::string&    _source_id
+        , const bool            _route_by_object_id)
+    {
+        span s{"copy_duplicate_chunks"};
+        s.set("index", _index_name);
+
+        auto search = [&](const json& _body, const std::string& _routing) {
+            const cpr::Response response = _client.performRequest(
+                                               elasticlient::Client::HTTPMethod::POST
+                                             , _index_name + "/_search"
+                                               + (_routing.empty() ? "" : "?routing=" + _routing)
+                                             , _body.dump());
+            if(response.status_code != 200) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("search of [{}] failed code [{}] message [{}]"
+                    , _index_name
+                    , response.status_code
+                    , response.text));
+            }
+
+            return json::parse(response.text).at("hits").at("hits");
+        };
+
+        try {
+            const auto source_id      = std::stoull(_source_id);
+            const auto source_routing = get_routing(_route_by_object_id, _source_id);
+
+            auto last = json{-1};
+            while(true) {
+                const auto hits = search({
+                    {"size",         _page_size},
+                    {"query",        {{"term", {{"object_id", source_id}}}}},
+                    {"sort",         json::array({json{{"chunk", "asc"}}})},
+                    {"search_after", last}}, source_routing);
+
+                if(hits.empty()) {
+                    break;
+                }
+
+                for(auto&& h : hits) {
+                    auto doc = h.at("_source");
+                    // recorded once every copied chunk is acknowledged
+                    doc.erase("checksum");
+                    doc["logical_path"] = _logical_path;
+                    doc["object_id"]    = std::stoull(_object_id);
+
+                    const auto index_id = fmt::format(
+                                              "{}{}{}"
+                                              , _object_id
+                                              , indexer_separator
+                                              , doc.at("chunk").get<uint64_t>());
+
+                    if(_bulk.index_document(
+                           _index_name
+                         , index_id
+                         , doc.dump()
+                         , get_routing(_route_by_object_id, _object_id))) {
+                        auto err = _bulk.perform(_logical_path);
+                        if(!err.ok()) {
+                            THROW(err.code(), err.result());
+                        }
+                    }
+                }
+
+                last = hits.back().at("sort");
+            }
+
+            s.set("copied", 1);
+            return true;
+        }
+        catch(const irods::exception& _e) {
+            rodsLog(
+                LOG_ERROR
+              , "failed to copy duplicate chunks for [%s] in [%s] [%s]"
+              , _logical_path.c_str()
+              , _index_name.c_str()
+              , _e.what());
+            s.set_error(_e.what());
+        }
+        catch(const std::exception& _e) {
+            rodsLog(
+                LOG_ERROR
+              , "failed to copy duplicate chunks for [%s] in [%s] [%s]"
+              , _logical_path.c_str()
+              , _index_name.c_str()
+              , _e.what());
+            s.set_error(_e.what());
+        }
+
+        return false;
+
+    } // copy_duplicate_chunks
+
+    // update the first chunk of each object with its checksum, called once
+    // the bulks holding the chunks have all been flushed without error.  an
+    // object which was partially indexed is then neither skipped as
+    // unchanged nor copied as a duplicate.
+    irods::error write_checksum_markers(
+          bulk_request&                       _bulk
+        , const std::vector<object_checksum>& _markers
+        , const std::string&                  _logical_path
+        , const bool                          _route_by_object_id)
+    {
+        if(_markers.empty()) {
+            return SUCCESS();
+        }
+
+        span s{"write_checksum_markers"};
+        s.set("documents", _markers.size());
+
+        for(auto&& m : _markers) {
+            if(_bulk.update_document(
+                   m.index_name
+                 , m.object_id + indexer_separator + "0"
+                 , json{{"doc", {{"checksum", m.checksum}}}}.dump()
+                 , get_routing(_route_by_object_id, m.object_id))) {
+                auto err = _bulk.perform(_logical_path);
+                if(!err.ok()) {
+                    return err;
+                }
+            }
+        }
+
+        return _bulk.flush(_logical_path);
+
+    } // write_checksum_markers
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_CHECKSUM_HPP
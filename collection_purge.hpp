@@ -0,0 +1,146 @@
+#ifndef IRODS_INDEXING_COLLECTION_PURGE_HPP
+#define IRODS_INDEXING_COLLECTION_PURGE_HPP
+
+#include "utilities.hpp"
+#include "query_task.hpp"
+
+#include "policy_composition_framework_keywords.hpp"
+
+#include <algorithm>
+#include <optional>
+
+namespace irods::indexing {
+
+    // the policy is invoked directly with the collection rather than with
+    // each of its objects by the query processor
+    auto is_collection_purge(
+          rsComm_t*          _comm
+        , const json&        _params
+        , const std::string& _logical_path)
+    {
+        if(!invoked_for_collection(_comm, _params, _logical_path)) {
+            return false;
+        }
+
+        namespace pkw = irods::policy_composition::keywords;
+
+        const auto [a, v, u, operation, e, t] = extract_all(_params.at("metadata"));
+
+        return pkw::remove == operation;
+
+    } // is_collection_purge
+
+    // a collection is purged by query only when a keyword field holds the
+    // whole logical path, otherwise its objects are purged one at a time
+    std::optional<query_task_configuration> get_collection_purge_configuration(
+        const pe::configuration_manager& _cfg)
+    {
+        if(_cfg.get("path_field", std::string{}).empty()
+           && !get_template_configuration(_cfg).managed) {
+            return std::nullopt;
+        }
+
+        return get_query_task_configuration(_cfg);
+
+    } // get_collection_purge_configuration
+
+    // a collection above this one still carries the index, so that its
+    // documents remain indexed once the avu is removed from this one
+    auto is_covered_by_parent(
+          rsComm_t*          _comm
+        , const std::string& _collection
+        , const std::string& _index_name
+        , const std::string& _index_type)
+    {
+        const auto names = get_index_names_for_collections(
+                               _comm
+                             , get_parent_collections(_collection)
+                             , _index_type);
+
+        return std::find(names.begin(), names.end(), _index_name) != names.end();
+
+    } // is_covered_by_parent
+
+    // the outermost collections beneath this one which are tagged with the
+    // same index, whose documents are to be left in place
+    auto get_tagged_subcollections(
+          rsComm_t*          _comm
+        , const std::string& _collection
+        , const std::string& _index_name
+        , const std::string& _index_type)
+    {
+        const auto qstr = fmt::format(
+            "SELECT COLL_NAME WHERE META_COLL_ATTR_NAME = '{}' AND META_COLL_ATTR_VALUE = '{}{}{}' AND META_COLL_ATTR_UNITS = '{}' AND COLL_NAME like '{}/%'"
+            , indexing_attribute
+            , _index_name
+            , indexer_separator
+            , _index_type
+            , elasticsearch_units
+            , _collection);
+
+        std::vector<std::string> colls{};
+        for(const auto& row : irods::query<rsComm_t>{_comm, qstr}) {
+            // like also matches _ and % within the collection name itself
+            if(0 == row[0].compare(0, _collection.size() + 1, _collection + "/")) {
+                colls.push_back(row[0]);
+            }
+        }
+
+        // a tagged collection within another is already spared with it
+        std::sort(colls.begin(), colls.end());
+
+        std::vector<std::string> outermost{};
+        for(auto&& c : colls) {
+            if(outermost.empty()
+               || 0 != c.compare(0, outermost.back().size() + 1, outermost.back() + "/")) {
+                outermost.push_back(c);
+            }
+        }
+
+        return outermost;
+
+    } // get_tagged_subcollections
+
+    // remove every document under the collection from the index with a single
+    // delete by query, run as a task on the cluster which is polled until it
+    // completes.  collections beneath it which are still tagged with the index
+    // keep their documents.
+    irods::error purge_collection(
+          rsComm_t*                       _comm
+        , elasticsearch_client&           _client
+        , const query_task_configuration& _config
+        , const std::string&              _collection
+        , const std::string&              _index_name
+        , const std::string&              _index_type
+        , const bool                      _log_verbose)
+    {
+        auto query = make_collection_query(_config.path_field, _collection);
+
+        auto spared = json::array();
+        for(auto&& c : get_tagged_subcollections(_comm, _collection, _index_name, _index_type)) {
+            spared.push_back(make_collection_query(_config.path_field, c));
+
+            if(_log_verbose) {
+                rodsLog(LOG_NOTICE, "purge of [%s] spares [%s] in [%s]", _collection.c_str(), c.c_str(), _index_name.c_str());
+            }
+        }
+
+        if(!spared.empty()) {
+            query = json{{"bool", {
+                        {"must",     json::array({query})},
+                        {"must_not", spared}}}};
+        }
+
+        return run_query_task(
+                   _client
+                 , _index_name
+                 , "_delete_by_query"
+                 , json{{"query", query}}
+                 , fmt::format("purge of [{}] from [{}]", _collection, _index_name)
+                 , query_task_options{true, _config.poll_interval_ms, false, _log_verbose});
+
+    } // purge_collection
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_COLLECTION_PURGE_HPP
@@ -0,0 +1,356 @@
+#ifndef IRODS_INDEXING_HOST_SELECTOR_HPP
+#define IRODS_INDEXING_HOST_SELECTOR_HPP
+
+// host selection shared by the policy plugins and the indexing daemon, kept
+// free of irods headers so the daemon may be built without the server.
+//
+// each host carries an exponentially weighted moving average of its latency
+// and error rate for the life of the process.  requests go to the healthy
+// host with the lowest latency, weighted by its error rate, failing over to
+// the next.  a host which fails breaker_failures times in a row is ejected
+// and receives no requests until probe_interval_ms has passed, after which
+// a single request probes it.  a healthy host left unused for as long is
+// measured again so that one which has recovered from a stall is used.
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace irods::indexing {
+
+    struct client_configuration {
+        std::vector<std::string> hosts;
+        // longest a single request to one host may take
+        uint32_t request_timeout_ms{6000};
+        // consecutive failures after which a host is ejected
+        uint32_t breaker_failures{3};
+        // time before an ejected or unused host is probed
+        uint32_t probe_interval_ms{10000};
+        // bulk requests outstanding at once for each bulk
+        uint32_t max_in_flight{4};
+        // times the items of a bulk which failed transiently are sent again,
+        // waiting twice as long before each
+        uint32_t bulk_retries{3};
+        uint32_t retry_backoff_ms{500};
+    };
+
+    // read from anything offering get(key, default), such as the policy
+    // configuration manager
+    template <typename Configuration>
+    auto get_client_configuration(const Configuration& _cfg)
+    {
+        // clang-format off
+        return client_configuration{
+                   _cfg.get("hosts",              std::vector<std::string>{})
+                 , _cfg.get("request_timeout_ms", uint32_t{6000})
+                 , _cfg.get("breaker_failures",   uint32_t{3})
+                 , _cfg.get("probe_interval_ms",  uint32_t{10000})
+                 , _cfg.get("max_in_flight",      uint32_t{4})
+                 , _cfg.get("bulk_retries",       uint32_t{3})
+                 , _cfg.get("retry_backoff_ms",   uint32_t{500})};
+        // clang-format on
+
+    } // get_client_configuration
+
+    class host_selector {
+    public:
+        using clock_type   = std::chrono::steady_clock;
+        using log_function = std::function<void(const std::string&)>;
+
+        static host_selector& instance()
+        {
+            static host_selector s;
+            return s;
+        }
+
+        void set_log_function(log_function _log)
+        {
+            std::lock_guard lk{mutex_};
+            log_ = _log;
+        }
+
+        // the configured hosts in the order in which they should be tried:
+        // ejected hosts due a probe, healthy hosts by score, then the other
+        // ejected hosts as a last resort
+        std::vector<std::string> order(const client_configuration& _cfg)
+        {
+            std::lock_guard lk{mutex_};
+
+            const auto now   = clock_type::now();
+            const auto probe = std::chrono::milliseconds{_cfg.probe_interval_ms};
+
+            std::vector<std::string> probes;
+            std::vector<std::string> healthy;
+            std::vector<std::string> ejected;
+
+            for(auto&& h : _cfg.hosts) {
+                auto& s = hosts_[h];
+
+                if(!s.ejected) {
+                    healthy.push_back(h);
+                }
+                else if(now - s.last_attempt >= probe) {
+                    // only one request in this process probes the host
+                    s.last_attempt = now;
+                    probes.push_back(h);
+                }
+                else {
+                    ejected.push_back(h);
+                }
+            }
+
+            // hosts without recent samples score zero and so are measured
+            std::stable_sort(
+                healthy.begin()
+              , healthy.end()
+              , [&](const std::string& _l, const std::string& _r) {
+                    return score(hosts_[_l], now, probe) < score(hosts_[_r], now, probe);
+                });
+
+            std::stable_sort(
+                ejected.begin()
+              , ejected.end()
+              , [this](const std::string& _l, const std::string& _r) {
+                    return hosts_[_l].last_attempt < hosts_[_r].last_attempt;
+                });
+
+            probes.insert(probes.end(), healthy.begin(), healthy.end());
+            probes.insert(probes.end(), ejected.begin(), ejected.end());
+
+            return probes;
+
+        } // order
+
+        void record_success(
+              const std::string& _host
+            , const double       _latency_ms)
+        {
+            std::lock_guard lk{mutex_};
+
+            auto& s = hosts_[_host];
+            update(s, _latency_ms, 0.0);
+            s.consecutive_failures = 0;
+
+            if(s.ejected) {
+                s.ejected = false;
+                log(fmt::format("elasticsearch host [{}] restored", _host));
+            }
+
+        } // record_success
+
+        // a throttled request says nothing of the health of the host, only
+        // its latency is sampled, leaving its error rate as it was
+        void record_latency(
+              const std::string& _host
+            , const double       _latency_ms)
+        {
+            std::lock_guard lk{mutex_};
+
+            auto& s = hosts_[_host];
+            update(s, _latency_ms, s.error_rate);
+
+        } // record_latency
+
+        void record_failure(
+              const std::string&          _host
+            , const double                _latency_ms
+            , const client_configuration& _cfg
+            , const std::string&          _reason)
+        {
+            std::lock_guard lk{mutex_};
+
+            auto& s = hosts_[_host];
+            update(s, _latency_ms, 1.0);
+            ++s.consecutive_failures;
+
+            if(!s.ejected && s.consecutive_failures >= _cfg.breaker_failures) {
+                s.ejected = true;
+                log(fmt::format(
+                        "elasticsearch host [{}] ejected after {} consecutive failures [{}]"
+                        , _host
+                        , s.consecutive_failures
+                        , _reason));
+            }
+
+        } // record_failure
+
+    private:
+        struct host_state {
+            double                 latency_ms{};
+            double                 error_rate{};
+            uint32_t               consecutive_failures{};
+            bool                   ejected{};
+            bool                   sampled{};
+            clock_type::time_point last_attempt{};
+        };
+
+        // weight of the newest sample in each moving average
+        static constexpr double alpha{0.3};
+        // how heavily errors count against a host's latency
+        static constexpr double error_penalty{10.0};
+
+        host_selector() = default;
+
+        static double score(
+              const host_state&               _s
+            , const clock_type::time_point    _now
+            , const std::chrono::milliseconds _probe)
+        {
+            if(!_s.sampled || _now - _s.last_attempt >= _probe) {
+                return 0.0;
+            }
+
+            return _s.latency_ms * (1.0 + error_penalty * _s.error_rate);
+        }
+
+        static void update(
+              host_state&  _s
+            , const double _latency_ms
+            , const double _error)
+        {
+            if(_s.sampled) {
+                _s.latency_ms = alpha * _latency_ms + (1.0 - alpha) * _s.latency_ms;
+                _s.error_rate = alpha * _error      + (1.0 - alpha) * _s.error_rate;
+            }
+            else {
+                _s.latency_ms = _latency_ms;
+                _s.error_rate = _error;
+                _s.sampled    = true;
+            }
+
+            _s.last_attempt = clock_type::now();
+
+        } // update
+
+        void log(const std::string& _msg)
+        {
+            if(log_) {
+                log_(_msg);
+            }
+        }
+
+        std::mutex                        mutex_;
+        std::map<std::string, host_state> hosts_;
+        log_function                      log_;
+
+    }; // class host_selector
+
+    // offers the elasticlient interface used by the policies, sending each
+    // request to the host chosen by the host selector rather than always
+    // starting from the first configured host
+    class elasticsearch_client {
+    public:
+        explicit elasticsearch_client(const client_configuration& _cfg)
+            : cfg_{_cfg}
+        {
+            for(auto&& h : cfg_.hosts) {
+                clients_.emplace(
+                    h
+                  , std::make_unique<elasticlient::Client>(
+                        std::vector<std::string>{h}
+                      , static_cast<std::int32_t>(cfg_.request_timeout_ms)));
+            }
+        }
+
+        const auto& configuration() const { return cfg_; }
+
+        // failing over on connection errors and 5xx responses.  a 429 is
+        // returned to the caller, which owns any retry, and is not counted
+        // as a failure of the host.
+        cpr::Response performRequest(
+              elasticlient::Client::HTTPMethod _method
+            , const std::string&               _path
+            , const std::string&               _body)
+        {
+            using clock_type = host_selector::clock_type;
+
+            auto& selector = host_selector::instance();
+
+            std::exception_ptr last_exception;
+            std::unique_ptr<cpr::Response> last_response;
+
+            for(auto&& host : selector.order(cfg_)) {
+                const auto start = clock_type::now();
+                auto elapsed_ms = [&start] {
+                    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+                };
+
+                try {
+                    cpr::Response r = clients_.at(host)->performRequest(_method, _path, _body);
+
+                    if(0 == r.status_code || r.status_code >= 500) {
+                        selector.record_failure(
+                            host
+                          , elapsed_ms()
+                          , cfg_
+                          , fmt::format("status {}", r.status_code));
+                        last_response = std::make_unique<cpr::Response>(std::move(r));
+                        continue;
+                    }
+
+                    if(429 == r.status_code) {
+                        selector.record_latency(host, elapsed_ms());
+                    }
+                    else {
+                        selector.record_success(host, elapsed_ms());
+                    }
+
+                    return r;
+                }
+                catch(const std::exception& _e) {
+                    selector.record_failure(host, elapsed_ms(), cfg_, _e.what());
+                    last_exception = std::current_exception();
+                }
+            } // for host
+
+            if(last_response) {
+                return *last_response;
+            }
+
+            if(last_exception) {
+                std::rethrow_exception(last_exception);
+            }
+
+            throw std::runtime_error("no elasticsearch hosts are configured");
+
+        } // performRequest
+
+        cpr::Response remove(
+              const std::string& _index_name
+            , const std::string& _doc_type
+            , const std::string& _id
+            , const std::string& _routing = {})
+        {
+            return performRequest(
+                       elasticlient::Client::HTTPMethod::DELETE
+                     , fmt::format(
+                           "{}/{}/{}{}"
+                         , _index_name
+                         , _doc_type
+                         , _id
+                         , _routing.empty() ? "" : "?routing=" + _routing)
+                     , "");
+
+        } // remove
+
+    private:
+        client_configuration                                         cfg_;
+        std::map<std::string, std::unique_ptr<elasticlient::Client>> clients_;
+
+    }; // class elasticsearch_client
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_HOST_SELECTOR_HPP
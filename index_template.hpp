@@ -0,0 +1,248 @@
+#ifndef IRODS_INDEXING_INDEX_TEMPLATE_HPP
+#define IRODS_INDEXING_INDEX_TEMPLATE_HPP
+
+// index templates owned by the policies.  rather than leaving the mappings
+// of an index to dynamic mapping, which analyzes every string as text with
+// a keyword subfield, the policies may put a versioned template for each
+// index they write before its first write in the process.  paths and avus
+// are mapped as keywords, and the full text is analyzed without norms and,
+// unless asked for, without positions.  a template only applies to indices
+// created after it, existing indices keep their mappings.
+
+#include "utilities.hpp"
+#include "host_selector.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <mutex>
+#include <set>
+
+namespace irods::indexing {
+
+    namespace template_mode {
+        // the mappings are left to dynamic mapping or to the administrator
+        const std::string unmanaged{"unmanaged"};
+        // the policies put a template for each index they write
+        const std::string managed{"managed"};
+    }
+
+    namespace source_policy {
+        // the whole document is kept in _source
+        const std::string full{"full"};
+        // as full, stored with the slower but smaller deflate codec
+        const std::string compressed{"compressed"};
+    }
+
+    // raised whenever the templates put by the policies change
+    constexpr uint32_t index_template_version{2};
+
+    struct template_configuration {
+        bool        managed;
+        std::string source;
+        // positions allow phrase queries on the full text, at a cost
+        bool        index_positions;
+    };
+
+    auto get_template_configuration(const pe::configuration_manager& _cfg)
+    {
+        // clang-format off
+        const auto mode      = _cfg.get("index_templates",          template_mode::unmanaged);
+        const auto source    = _cfg.get("template_source",          source_policy::full);
+        const auto positions = _cfg.get("template_index_positions", std::string{"false"});
+        // clang-format on
+
+        if(template_mode::unmanaged != mode && template_mode::managed != mode) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid index_templates [{}]", mode));
+        }
+
+        if(source_policy::full != source && source_policy::compressed != source) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid template_source [{}]", source));
+        }
+
+        return template_configuration{
+                   template_mode::managed == mode
+                 , source
+                 , std::string{"true"} == positions};
+
+    } // get_template_configuration
+
+    auto make_index_template(
+          const template_configuration& _cfg
+        , const std::string&            _index_name
+        , const std::string&            _index_type)
+    {
+        const json path{{"type", "keyword"}};
+        const json id{{"type", "long"}};
+        const json keyword{{"type", "keyword"}};
+        // values are matched exactly, and searched as text through value.text
+        const json value{
+            {"type",   "keyword"},
+            {"fields", {{"text", {{"type", "text"}}}}}};
+
+        auto settings = json::object();
+        json properties;
+
+        if(it::full_text == _index_type) {
+            settings["analysis"] = {
+                {"analyzer", {
+                    {"irods_full_text", {
+                        {"type",      "custom"},
+                        {"tokenizer", "standard"},
+                        {"filter",    json::array({"lowercase", "asciifolding"})}}}}}};
+
+            properties = {
+                {"logical_path", path},
+                {"object_id",    id},
+                {"chunk",        {{"type", "integer"}}},
+                {"checksum",     keyword},
+                {"data",         {
+                    {"type",          "text"},
+                    {"analyzer",      "irods_full_text"},
+                    {"norms",         false},
+                    {"index_options", _cfg.index_positions ? "positions" : "freqs"}}}};
+        }
+        else {
+            // holds the fields of both metadata layouts
+            properties = {
+                {"logical_path", path},
+                {"object_id",    id},
+                {"attribute",    keyword},
+                {"value",        value},
+                {"units",        keyword},
+                {"avus",         {
+                    {"type",       "nested"},
+                    {"properties", {
+                        {"attribute", keyword},
+                        {"value",     value},
+                        {"units",     keyword}}}}}};
+        }
+
+        if(source_policy::compressed == _cfg.source) {
+            settings["index.codec"] = "best_compression";
+        }
+
+        return json{
+            // the name itself, or the backing indices of a rollover alias
+            {"index_patterns", json::array({_index_name, _index_name + "-0*"})},
+            {"version",        index_template_version},
+            {"settings",       settings},
+            {"mappings",       {
+                {"text", {
+                    // fields the policies do not write are not indexed
+                    {"dynamic",    false},
+                    {"_source",    {{"enabled", true}}},
+                    {"properties", properties}}}}}};
+
+    } // make_index_template
+
+    // the indices of this process whose template is known to be in place
+    class index_templates {
+    public:
+        static index_templates& instance()
+        {
+            static index_templates t;
+            return t;
+        }
+
+        // put the template for the index unless a template of this or a
+        // later version is already in place.  failures are logged and left
+        // to dynamic mapping, and retried on the next call.
+        void ensure(
+              elasticsearch_client&         _client
+            , const template_configuration& _cfg
+            , const std::string&            _index_name
+            , const std::string&            _index_type)
+        {
+            if(!_cfg.managed) {
+                return;
+            }
+
+            // the same index name may be served by different clusters
+            auto key = _index_name;
+            for(auto&& h : _client.configuration().hosts) {
+                key += indexer_separator + h;
+            }
+
+            std::lock_guard lk{mutex_};
+
+            if(ensured_.count(key)) {
+                return;
+            }
+
+            const auto name = fmt::format("irods_indexing_{}", _index_name);
+
+            try {
+                const cpr::Response existing = _client.performRequest(
+                                                   elasticlient::Client::HTTPMethod::GET
+                                                 , "_template/" + name
+                                                 , "");
+                if(200 == existing.status_code) {
+                    const auto t = json::parse(existing.text);
+                    if(t.contains(name) && t.at(name).value("version", 0U) >= index_template_version) {
+                        ensured_.insert(key);
+                        return;
+                    }
+                }
+
+                const cpr::Response put = _client.performRequest(
+                                              elasticlient::Client::HTTPMethod::PUT
+                                            , "_template/" + name
+                                            , make_index_template(_cfg, _index_name, _index_type).dump());
+                if(200 != put.status_code) {
+                    rodsLog(
+                        LOG_ERROR
+                      , "failed to put index template [%s] code [%d] message [%s]"
+                      , name.c_str()
+                      , static_cast<int>(put.status_code)
+                      , put.text.c_str());
+                    return;
+                }
+
+                rodsLog(
+                    LOG_NOTICE
+                  , "put index template [%s] version [%u] for [%s]"
+                  , name.c_str()
+                  , index_template_version
+                  , _index_type.c_str());
+
+                ensured_.insert(key);
+            }
+            catch(const std::exception& _e) {
+                rodsLog(
+                    LOG_ERROR
+                  , "failed to ensure index template [%s] [%s]"
+                  , name.c_str()
+                  , _e.what());
+            }
+
+        } // ensure
+
+        void ensure(
+              elasticsearch_client&           _client
+            , const template_configuration&   _cfg
+            , const std::vector<std::string>& _index_names
+            , const std::string&              _index_type)
+        {
+            for(auto&& n : _index_names) {
+                ensure(_client, _cfg, n, _index_type);
+            }
+        }
+
+    private:
+        index_templates() = default;
+
+        std::mutex            mutex_;
+        std::set<std::string> ensured_;
+
+    }; // class index_templates
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_INDEX_TEMPLATE_HPP
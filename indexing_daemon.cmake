@@ -0,0 +1,54 @@
+set(DAEMON_NAME "irods_indexing_daemon")
+
+string(REPLACE "_" "-" DAEMON_NAME_HYPHENS ${DAEMON_NAME})
+set(IRODS_PACKAGE_COMPONENT_DAEMON_NAME "${DAEMON_NAME_HYPHENS}${IRODS_PACKAGE_FILE_NAME_SUFFIX}")
+string(TOUPPER ${IRODS_PACKAGE_COMPONENT_DAEMON_NAME} IRODS_PACKAGE_COMPONENT_DAEMON_NAME_UPPERCASE)
+
+add_executable(
+    ${DAEMON_NAME}
+    ${CMAKE_SOURCE_DIR}/${DAEMON_NAME}.cpp
+    )
+
+target_include_directories(
+    ${DAEMON_NAME}
+    PRIVATE
+    ${CMAKE_CURRENT_SOURCE_DIR}
+    ${IRODS_EXTERNALS_FULLPATH_JSON}/include
+    ${IRODS_EXTERNALS_FULLPATH_FMT}/include
+    /opt/irods-externals/elasticlient0.1.0-0/include
+    /opt/irods-externals/cpr1.3.0-0/include
+    )
+
+target_link_libraries(
+    ${DAEMON_NAME}
+    PRIVATE
+    ${IRODS_EXTERNALS_FULLPATH_FMT}/lib/libfmt.so
+    /opt/irods-externals/elasticlient0.1.0-0/lib/libelasticlient.so
+    /opt/irods-externals/elasticlient0.1.0-0/lib/libjsoncpp.so
+    /opt/irods-externals/cpr1.3.0-0/lib/libcpr.so
+    pthread
+    )
+
+set_property(TARGET ${DAEMON_NAME} PROPERTY CXX_STANDARD ${IRODS_CXX_STANDARD})
+
+install(
+  TARGETS
+  ${DAEMON_NAME}
+  RUNTIME
+  DESTINATION usr/sbin
+  COMPONENT ${IRODS_PACKAGE_COMPONENT_DAEMON_NAME}
+  )
+
+install(
+  FILES
+  packaging/${DAEMON_NAME}.service
+  DESTINATION usr/lib/systemd/system
+  COMPONENT ${IRODS_PACKAGE_COMPONENT_DAEMON_NAME}
+  )
+
+set(CPACK_DEBIAN_${IRODS_PACKAGE_COMPONENT_DAEMON_NAME_UPPERCASE}_FILE_NAME ${DAEMON_NAME_HYPHENS}-${IRODS_PLUGIN_VERSION}-${IRODS_LINUX_DISTRIBUTION_NAME}-${IRODS_LINUX_DISTRIBUTION_VERSION_MAJOR}-${CMAKE_SYSTEM_PROCESSOR}.deb)
+set(CPACK_DEBIAN_${IRODS_PACKAGE_COMPONENT_DAEMON_NAME_UPPERCASE}_PACKAGE_NAME ${DAEMON_NAME_HYPHENS})
+set(CPACK_DEBIAN_${IRODS_PACKAGE_COMPONENT_DAEMON_NAME_UPPERCASE}_PACKAGE_DEPENDS "${IRODS_PACKAGE_DEPENDENCIES_STRING}, libc6")
+
+set(CPACK_RPM_${IRODS_PACKAGE_COMPONENT_DAEMON_NAME}_PACKAGE_NAME ${DAEMON_NAME_HYPHENS})
+set(CPACK_RPM_${IRODS_PACKAGE_COMPONENT_DAEMON_NAME}_PACKAGE_REQUIRES "${IRODS_PACKAGE_DEPENDENCIES_STRING}")
@@ -0,0 +1,130 @@
+#ifndef IRODS_INDEXING_DAEMON_CLIENT_HPP
+#define IRODS_INDEXING_DAEMON_CLIENT_HPP
+
+#include "utilities.hpp"
+#include "indexing_daemon_protocol.hpp"
+
+#include <map>
+#include <mutex>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace irods::indexing {
+
+    // a connection to the local indexing daemon, shared by every invocation
+    // of the policies within an agent and kept open for its lifetime
+    class daemon_client {
+    public:
+        static daemon_client& instance(const std::string& _socket_path)
+        {
+            static std::mutex mtx;
+            static std::map<std::string, std::unique_ptr<daemon_client>> clients;
+
+            std::lock_guard<std::mutex> lk{mtx};
+
+            auto& c = clients[_socket_path];
+            if(!c) {
+                c.reset(new daemon_client{_socket_path});
+            }
+
+            return *c;
+
+        } // instance
+
+        ~daemon_client()
+        {
+            disconnect();
+        }
+
+        daemon_client(const daemon_client&) = delete;
+        daemon_client& operator=(const daemon_client&) = delete;
+
+        void send(const protocol::frame& _frame)
+        {
+            send(_frame.operation, {_frame.fields.begin(), _frame.fields.end()});
+
+        } // send
+
+        // the fields are written from the caller's buffers without a copy
+        void send(
+              const protocol::operation_type       _operation
+            , const std::vector<std::string_view>& _fields)
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+
+            // the daemon may have restarted since the last write, reconnect once
+            for(int attempt = 0; attempt < 2; ++attempt) {
+                if(fd_ < 0) {
+                    connect();
+                }
+
+                if(protocol::write_frame(fd_, _operation, _fields)) {
+                    return;
+                }
+
+                disconnect();
+            }
+
+            THROW(
+                SYS_SOCK_CONNECT_ERR,
+                fmt::format("failed to write to indexing daemon [{}] [{}]"
+                , socket_path_
+                , std::strerror(errno)));
+
+        } // send
+
+    private:
+        explicit daemon_client(const std::string& _socket_path)
+            : socket_path_{_socket_path}
+        {
+        }
+
+        void connect()
+        {
+            sockaddr_un addr{};
+            if(socket_path_.size() >= sizeof(addr.sun_path)) {
+                THROW(
+                    SYS_INVALID_INPUT_PARAM,
+                    fmt::format("daemon socket path is too long [{}]", socket_path_));
+            }
+
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+            fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(fd_ < 0) {
+                THROW(
+                    SYS_SOCK_CONNECT_ERR,
+                    fmt::format("failed to create socket [{}]", std::strerror(errno)));
+            }
+
+            if(::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                const auto msg = fmt::format(
+                                     "failed to connect to indexing daemon [{}] [{}]"
+                                     , socket_path_
+                                     , std::strerror(errno));
+                disconnect();
+                THROW(SYS_SOCK_CONNECT_ERR, msg);
+            }
+
+        } // connect
+
+        void disconnect()
+        {
+            if(fd_ >= 0) {
+                ::close(fd_);
+                fd_ = -1;
+            }
+
+        } // disconnect
+
+        const std::string socket_path_;
+        std::mutex        mutex_;
+        int               fd_{-1};
+
+    }; // class daemon_client
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_DAEMON_CLIENT_HPP
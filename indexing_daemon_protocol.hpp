@@ -0,0 +1,246 @@
+#ifndef IRODS_INDEXING_DAEMON_PROTOCOL_HPP
+#define IRODS_INDEXING_DAEMON_PROTOCOL_HPP
+
+// framing shared by the policy plugins and the indexing daemon, kept free
+// of irods headers so the daemon may be built without the server.
+//
+// a frame is a fixed header followed by a payload of length prefixed
+// fields, all integers in network byte order:
+//
+//     uint32 magic
+//     uint8  version
+//     uint8  operation
+//     uint16 field count
+//     uint32 payload length
+//     field count * (uint32 length, bytes)
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace irods::indexing::protocol {
+
+    constexpr uint32_t    magic{0x49584431}; // IXD1
+    constexpr uint8_t     version{1};
+    constexpr std::size_t header_size{12};
+    constexpr uint32_t    max_payload_size{256 * 1024 * 1024};
+
+    enum class operation_type : uint8_t {
+        // fields: newline delimited bulk actions
+        bulk         = 1,
+        // fields: index name, object id, and optionally the routing of the
+        // chunks, empty when they are not routed
+        purge_chunks = 3
+    };
+
+    struct frame {
+        operation_type           operation;
+        std::vector<std::string> fields;
+    };
+
+    inline void append_uint32(std::string& _out, const uint32_t _value)
+    {
+        const uint32_t n = htonl(_value);
+        _out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    }
+
+    inline uint32_t extract_uint32(const char* _in)
+    {
+        uint32_t n{};
+        std::memcpy(&n, _in, sizeof(n));
+        return ntohl(n);
+    }
+
+    // write a frame gathering its fields straight from the caller's buffers
+    // rather than copying them into one, failing as write_all does should
+    // the peer have gone away
+    inline bool write_frame(
+          const int                            _fd
+        , const operation_type                 _operation
+        , const std::vector<std::string_view>& _fields)
+    {
+        std::size_t payload_size{};
+        for(auto&& f : _fields) {
+            payload_size += sizeof(uint32_t) + f.size();
+        }
+
+        if(payload_size > max_payload_size) {
+            throw std::length_error{"frame payload exceeds maximum size"};
+        }
+
+        std::string header;
+        header.reserve(header_size + sizeof(uint32_t) * _fields.size());
+
+        append_uint32(header, magic);
+        header.push_back(static_cast<char>(version));
+        header.push_back(static_cast<char>(_operation));
+
+        const uint16_t count = htons(static_cast<uint16_t>(_fields.size()));
+        header.append(reinterpret_cast<const char*>(&count), sizeof(count));
+
+        append_uint32(header, static_cast<uint32_t>(payload_size));
+
+        for(auto&& f : _fields) {
+            append_uint32(header, static_cast<uint32_t>(f.size()));
+        }
+
+        // the frame header, then each field preceded by its length
+        std::vector<iovec> iov;
+        iov.reserve(1 + 2 * _fields.size());
+        iov.push_back({header.data(), header_size});
+
+        for(std::size_t i = 0; i < _fields.size(); ++i) {
+            iov.push_back({header.data() + header_size + i * sizeof(uint32_t), sizeof(uint32_t)});
+            if(!_fields[i].empty()) {
+                iov.push_back({const_cast<char*>(_fields[i].data()), _fields[i].size()});
+            }
+        }
+
+        std::size_t next{};
+        while(next < iov.size()) {
+            msghdr msg{};
+            msg.msg_iov    = iov.data() + next;
+            msg.msg_iovlen = std::min<std::size_t>(iov.size() - next, IOV_MAX);
+
+            auto n = ::sendmsg(_fd, &msg, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(EINTR == errno) {
+                    continue;
+                }
+                return false;
+            }
+
+            // skip what was written, partway into a buffer if need be
+            while(n > 0 && next < iov.size()) {
+                auto& v = iov[next];
+                if(static_cast<std::size_t>(n) >= v.iov_len) {
+                    n -= v.iov_len;
+                    ++next;
+                }
+                else {
+                    v.iov_base = static_cast<char*>(v.iov_base) + n;
+                    v.iov_len -= n;
+                    n = 0;
+                }
+            }
+        }
+
+        return true;
+
+    } // write_frame
+
+    // writes to a peer which has gone away fail rather than raise SIGPIPE
+    inline bool write_all(const int _fd, const char* _buffer, std::size_t _size)
+    {
+        while(_size > 0) {
+            const auto n = ::send(_fd, _buffer, _size, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(EINTR == errno) {
+                    continue;
+                }
+                return false;
+            }
+
+            _buffer += n;
+            _size   -= n;
+        }
+
+        return true;
+
+    } // write_all
+
+    // returns false on end of stream before any byte was read
+    inline bool read_all(const int _fd, char* _buffer, std::size_t _size)
+    {
+        std::size_t total{};
+        while(total < _size) {
+            const auto n = ::read(_fd, _buffer + total, _size - total);
+            if(n < 0) {
+                if(EINTR == errno) {
+                    continue;
+                }
+                throw std::runtime_error{std::string{"read failed: "} + std::strerror(errno)};
+            }
+
+            if(0 == n) {
+                if(0 == total) {
+                    return false;
+                }
+                throw std::runtime_error{"connection closed within a frame"};
+            }
+
+            total += n;
+        }
+
+        return true;
+
+    } // read_all
+
+    // returns false when the peer has closed the connection
+    inline bool read_frame(const int _fd, frame& _frame)
+    {
+        char header[header_size];
+        if(!read_all(_fd, header, header_size)) {
+            return false;
+        }
+
+        if(magic != extract_uint32(header)) {
+            throw std::runtime_error{"invalid frame magic"};
+        }
+
+        if(version != static_cast<uint8_t>(header[4])) {
+            throw std::runtime_error{"unsupported frame version"};
+        }
+
+        uint16_t count{};
+        std::memcpy(&count, header + 6, sizeof(count));
+        count = ntohs(count);
+
+        const auto payload_size = extract_uint32(header + 8);
+        if(payload_size > max_payload_size) {
+            throw std::runtime_error{"frame payload exceeds maximum size"};
+        }
+
+        std::string payload(payload_size, '\0');
+        if(payload_size > 0 && !read_all(_fd, payload.data(), payload_size)) {
+            throw std::runtime_error{"connection closed within a frame"};
+        }
+
+        _frame.operation = static_cast<operation_type>(header[5]);
+        _frame.fields.clear();
+
+        std::size_t pos{};
+        for(uint16_t i = 0; i < count; ++i) {
+            if(pos + sizeof(uint32_t) > payload.size()) {
+                throw std::runtime_error{"truncated frame field"};
+            }
+
+            const auto size = extract_uint32(payload.data() + pos);
+            pos += sizeof(uint32_t);
+
+            if(pos + size > payload.size()) {
+                throw std::runtime_error{"truncated frame field"};
+            }
+
+            _frame.fields.emplace_back(payload.data() + pos, size);
+            pos += size;
+        }
+
+        return true;
+
+    } // read_frame
+
+} // namespace irods::indexing::protocol
+
+#endif // IRODS_INDEXING_DAEMON_PROTOCOL_HPP
@@ -0,0 +1,888 @@
+// a local daemon which receives indexing operations from the policy plugins
+// of every agent on this server over a unix domain socket, aggregates them
+// into large bulk requests and sends them to elasticsearch, retrying those
+// which fail with a transient error.  the operations on the documents of an
+// object are all sent, and retried, in order by the same sender.
+
+#include "indexing_daemon_protocol.hpp"
+#include "host_selector.hpp"
+#include "bulk_response.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+#include "elasticlient/logging.h"
+
+#include "fmt/format.h"
+#include "json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <ctime>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace {
+    // clang-format off
+    namespace proto = irods::indexing::protocol;
+    namespace idx   = irods::indexing;
+    using     json  = nlohmann::json;
+    using     clock_type = std::chrono::steady_clock;
+    // clang-format on
+
+    std::atomic<bool> running{true};
+
+    void log(const char* _level, const std::string& _message)
+    {
+        static std::mutex mtx;
+
+        char stamp[32]{};
+        const auto now = std::time(nullptr);
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        std::lock_guard<std::mutex> lk{mtx};
+        std::cerr << stamp << " " << _level << " " << _message << std::endl;
+
+    } // log
+
+    struct configuration {
+        std::string              socket_path{"/var/lib/irods/indexing_daemon.sock"};
+        std::vector<std::string> hosts{"http://localhost:9200/"};
+        uint32_t                 bulk_count{1000};
+        uint64_t                 bulk_bytes{10 * 1024 * 1024};
+        uint32_t                 flush_interval_ms{1000};
+        uint32_t                 max_retries{5};
+        uint32_t                 retry_backoff_ms{500};
+        uint32_t                 senders{4};
+        uint64_t                 max_queue{100000};
+        uint32_t                 request_timeout_ms{6000};
+        uint32_t                 breaker_failures{3};
+        uint32_t                 probe_interval_ms{10000};
+        uint32_t                 metrics_interval_ms{60000};
+        std::string              metrics_path{};
+    };
+
+    configuration load_configuration(const std::string& _path)
+    {
+        configuration c{};
+
+        std::ifstream in{_path};
+        if(!in) {
+            log("NOTICE", fmt::format("configuration [{}] not found, using defaults", _path));
+            return c;
+        }
+
+        const auto j = json::parse(in);
+
+        // clang-format off
+        c.socket_path         = j.value("socket_path",         c.socket_path);
+        c.hosts               = j.value("hosts",               c.hosts);
+        c.bulk_count          = j.value("bulk_count",          c.bulk_count);
+        c.bulk_bytes          = j.value("bulk_bytes",          c.bulk_bytes);
+        c.flush_interval_ms   = j.value("flush_interval_ms",   c.flush_interval_ms);
+        c.max_retries         = j.value("max_retries",         c.max_retries);
+        c.retry_backoff_ms    = j.value("retry_backoff_ms",    c.retry_backoff_ms);
+        c.senders             = j.value("senders",             c.senders);
+        c.max_queue           = j.value("max_queue",           c.max_queue);
+        c.request_timeout_ms  = j.value("request_timeout_ms",  c.request_timeout_ms);
+        c.breaker_failures    = j.value("breaker_failures",    c.breaker_failures);
+        c.probe_interval_ms   = j.value("probe_interval_ms",   c.probe_interval_ms);
+        c.metrics_interval_ms = j.value("metrics_interval_ms", c.metrics_interval_ms);
+        c.metrics_path        = j.value("metrics_path",        c.metrics_path);
+        // clang-format on
+
+        return c;
+
+    } // load_configuration
+
+    // a bulk action with its optional source line, or a request which can
+    // not be expressed as a bulk action
+    struct operation {
+        proto::operation_type type;
+        std::string           first;
+        std::string           second;
+        // the routing of chunks to purge
+        std::string           routing{};
+        uint32_t              attempts{};
+        // operations with the same key are sent in the order they arrived,
+        // the object whose documents they act upon
+        std::string           key{};
+
+        auto size() const { return first.size() + second.size() + 2; }
+    };
+
+    // counts of operations since the daemon started, reported periodically
+    struct metrics {
+        std::atomic<uint64_t> received{};
+        std::atomic<uint64_t> sent{};
+        std::atomic<uint64_t> retried{};
+        std::atomic<uint64_t> failed{};
+    };
+
+    metrics counters;
+
+    // holds the pending operations of one sender along with those waiting out
+    // a retry backoff.  while an operation waits, those which arrive after it
+    // with the same key are held back until it has been queued again.
+    class operation_queue {
+    public:
+        explicit operation_queue(const uint64_t _max_size)
+            : max_size_{_max_size}
+        {
+        }
+
+        // blocks while the queue is full, pushing back on the agents
+        void push(operation&& _op)
+        {
+            std::unique_lock<std::mutex> lk{mutex_};
+            not_full_.wait(lk, [this] { return size() < max_size_ || stopped_; });
+
+            if(auto it = held_.find(_op.key); it != held_.end()) {
+                it->second.push_back(std::move(_op));
+                ++held_size_;
+                return;
+            }
+
+            queue_.push_back(std::move(_op));
+            not_empty_.notify_one();
+        }
+
+        void retry(operation&& _op, const std::chrono::milliseconds _delay)
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+
+            // whatever is queued for the key arrived after the operation
+            auto& held = held_[_op.key];
+            for(auto it = queue_.begin(); it != queue_.end();) {
+                if(it->key == _op.key) {
+                    held.push_back(std::move(*it));
+                    ++held_size_;
+                    it = queue_.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+
+            ++waiting_[_op.key];
+            delayed_.emplace(clock_type::now() + _delay, std::move(_op));
+            not_empty_.notify_one();
+        }
+
+        // operations of a batch which followed one of their key into a
+        // backoff, placed ahead of those held since
+        void hold(std::vector<operation>&& _ops)
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+
+            for(auto it = _ops.rbegin(); it != _ops.rend(); ++it) {
+                if(!waiting_.count(it->key)) {
+                    queue_.push_front(std::move(*it));
+                    continue;
+                }
+
+                held_[it->key].push_front(std::move(*it));
+                ++held_size_;
+            }
+
+            not_empty_.notify_one();
+        }
+
+        // wait for a full bulk or the flush interval, whichever comes first.
+        // an empty result with the queue stopped means there is no more work.
+        std::vector<operation> pop_batch(
+              const uint32_t                  _count
+            , const uint64_t                  _bytes
+            , const std::chrono::milliseconds _interval)
+        {
+            std::unique_lock<std::mutex> lk{mutex_};
+
+            const auto deadline = clock_type::now() + _interval;
+            while(true) {
+                promote_delayed();
+
+                if(queue_.size() >= _count || stopped_) {
+                    break;
+                }
+
+                auto wake = deadline;
+                if(!delayed_.empty()) {
+                    wake = std::min(wake, delayed_.begin()->first);
+                }
+
+                if(std::cv_status::timeout == not_empty_.wait_until(lk, wake)
+                   && clock_type::now() >= deadline) {
+                    promote_delayed();
+                    break;
+                }
+            }
+
+            std::vector<operation> batch;
+            uint64_t bytes{};
+            while(!queue_.empty() && batch.size() < _count && bytes < _bytes) {
+                bytes += queue_.front().size();
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+
+            not_full_.notify_all();
+
+            return batch;
+
+        } // pop_batch
+
+        void stop()
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+            stopped_ = true;
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+        bool drained()
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+            return queue_.empty() && delayed_.empty() && held_.empty();
+        }
+
+        uint64_t pending()
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+            return size();
+        }
+
+    private:
+        uint64_t size() const
+        {
+            return queue_.size() + delayed_.size() + held_size_;
+        }
+
+        // an operation whose backoff has passed is queued again, followed by
+        // those held behind it once no other operation of its key waits
+        void promote_delayed()
+        {
+            const auto now = clock_type::now();
+            while(!delayed_.empty() && (delayed_.begin()->first <= now || stopped_)) {
+                auto op = std::move(delayed_.begin()->second);
+                delayed_.erase(delayed_.begin());
+
+                const auto key = op.key;
+                queue_.push_back(std::move(op));
+
+                if(0 == --waiting_[key]) {
+                    waiting_.erase(key);
+
+                    auto it = held_.find(key);
+                    if(it != held_.end()) {
+                        held_size_ -= it->second.size();
+                        for(auto&& h : it->second) {
+                            queue_.push_back(std::move(h));
+                        }
+                        held_.erase(it);
+                    }
+                }
+            }
+        }
+
+        const uint64_t                                   max_size_;
+        std::mutex                                       mutex_;
+        std::condition_variable                          not_empty_;
+        std::condition_variable                          not_full_;
+        std::deque<operation>                            queue_;
+        std::multimap<clock_type::time_point, operation> delayed_;
+        // the number of delayed operations of each key
+        std::map<std::string, uint32_t>                  waiting_;
+        // operations waiting on a delayed operation of their key
+        std::map<std::string, std::deque<operation>>     held_;
+        uint64_t                                         held_size_{};
+        bool                                             stopped_{};
+
+    }; // class operation_queue
+
+    // a queue for each sender
+    using queue_set = std::vector<std::unique_ptr<operation_queue>>;
+
+    // the object of the document named by an action, its id up to the
+    // separator of a chunk number or avu digest
+    std::string ordering_key(const std::string& _action)
+    {
+        const std::string field{"\"_id\":\""};
+
+        const auto begin = _action.find(field);
+        if(std::string::npos == begin) {
+            return {};
+        }
+
+        const auto start = begin + field.size();
+        const auto id    = _action.substr(start, _action.find('"', start) - start);
+
+        return id.substr(0, id.find("::"));
+
+    } // ordering_key
+
+    // the operations of a key are all handled by the same sender
+    void dispatch(queue_set& _queues, operation&& _op)
+    {
+        ++counters.received;
+
+        const auto i = std::hash<std::string>{}(_op.key) % _queues.size();
+        _queues[i]->push(std::move(_op));
+
+    } // dispatch
+
+    // split newline delimited bulk actions into operations, an action line
+    // is followed by a source line for everything but a delete
+    void enqueue_bulk(queue_set& _queues, const std::string& _body)
+    {
+        std::size_t pos{};
+        while(pos < _body.size()) {
+            auto end = _body.find('\n', pos);
+            if(std::string::npos == end) {
+                end = _body.size();
+            }
+
+            operation op{proto::operation_type::bulk, _body.substr(pos, end - pos), {}};
+            pos = end + 1;
+
+            if(op.first.empty()) {
+                continue;
+            }
+
+            if(std::string::npos == op.first.find("\"delete\"")) {
+                end = _body.find('\n', pos);
+                if(std::string::npos == end) {
+                    end = _body.size();
+                }
+
+                op.second = _body.substr(pos, end - pos);
+                pos = end + 1;
+            }
+
+            op.key = ordering_key(op.first);
+            dispatch(_queues, std::move(op));
+        }
+
+    } // enqueue_bulk
+
+    void serve_connection(const int _fd, queue_set& _queues)
+    {
+        try {
+            proto::frame f;
+            // read until the agent goes away, or the connection is shut
+            // down once the daemon is stopping and every frame already
+            // written has been read
+            while(proto::read_frame(_fd, f)) {
+                switch(f.operation) {
+                    case proto::operation_type::bulk:
+                        for(auto&& body : f.fields) {
+                            enqueue_bulk(_queues, body);
+                        }
+                        break;
+
+                    case proto::operation_type::purge_chunks:
+                        if(2 != f.fields.size() && 3 != f.fields.size()) {
+                            throw std::runtime_error{"invalid field count"};
+                        }
+                        dispatch(_queues, {
+                            f.operation
+                          , f.fields[0]
+                          , f.fields[1]
+                          , 3 == f.fields.size() ? f.fields[2] : std::string{}
+                          , 0
+                          , f.fields[1]});
+                        break;
+
+                    default:
+                        throw std::runtime_error{
+                            fmt::format("unknown operation [{}]", static_cast<int>(f.operation))};
+                }
+            }
+        }
+        catch(const std::exception& _e) {
+            log("ERROR", fmt::format("dropping connection [{}]", _e.what()));
+        }
+
+    } // serve_connection
+
+    // the connections of the agents, each served by its own thread.  the
+    // descriptor is closed only once its thread has been joined, so that it
+    // may be shut down meanwhile without touching a reused descriptor.
+    class connection_set {
+    public:
+        explicit connection_set(queue_set& _queues)
+            : queues_{_queues}
+        {
+        }
+
+        connection_set(const connection_set&) = delete;
+        connection_set& operator=(const connection_set&) = delete;
+
+        ~connection_set()
+        {
+            close_all();
+        }
+
+        void add(const int _fd)
+        {
+            reap();
+
+            auto c = std::make_unique<connection>();
+            c->fd     = _fd;
+            c->thread = std::thread{[this, c = c.get()] {
+                serve_connection(c->fd, queues_);
+                c->done = true;
+            }};
+
+            std::lock_guard<std::mutex> lk{mutex_};
+            connections_.push_back(std::move(c));
+
+        } // add
+
+        // stop reading from every agent and wait for the frames already
+        // written to be queued
+        void close_all()
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+
+            for(auto&& c : connections_) {
+                ::shutdown(c->fd, SHUT_RDWR);
+            }
+
+            for(auto&& c : connections_) {
+                c->thread.join();
+                ::close(c->fd);
+            }
+
+            connections_.clear();
+
+        } // close_all
+
+    private:
+        struct connection {
+            int               fd{-1};
+            std::thread       thread;
+            std::atomic<bool> done{};
+        };
+
+        // join the threads of the connections which have ended
+        void reap()
+        {
+            std::lock_guard<std::mutex> lk{mutex_};
+
+            for(auto it = connections_.begin(); it != connections_.end();) {
+                if(!(*it)->done) {
+                    ++it;
+                    continue;
+                }
+
+                (*it)->thread.join();
+                ::close((*it)->fd);
+                it = connections_.erase(it);
+            }
+
+        } // reap
+
+        queue_set&                               queues_;
+        std::mutex                               mutex_;
+        std::vector<std::unique_ptr<connection>> connections_;
+
+    }; // class connection_set
+
+    class sender {
+    public:
+        sender(const configuration& _config, operation_queue& _queue)
+            : config_{_config}
+            , queue_{_queue}
+            , client_{idx::client_configuration{
+                  _config.hosts
+                , _config.request_timeout_ms
+                , _config.breaker_failures
+                , _config.probe_interval_ms}}
+        {
+        }
+
+        void run()
+        {
+            const auto interval = std::chrono::milliseconds{config_.flush_interval_ms};
+
+            while(true) {
+                auto batch = queue_.pop_batch(config_.bulk_count, config_.bulk_bytes, interval);
+                if(batch.empty()) {
+                    if(!running && queue_.drained()) {
+                        return;
+                    }
+                    continue;
+                }
+
+                // a purge is sent once the bulk actions before it have been
+                std::vector<operation> bulk;
+                std::vector<operation> deferred;
+
+                auto send_bulk = [&] {
+                    if(!bulk.empty()) {
+                        perform_bulk(std::move(bulk));
+                        bulk.clear();
+                    }
+                };
+
+                retried_.clear();
+
+                for(auto&& op : batch) {
+                    if(retried_.count(op.key)) {
+                        deferred.push_back(std::move(op));
+                    }
+                    else if(proto::operation_type::bulk == op.type) {
+                        bulk.push_back(std::move(op));
+                    }
+                    else {
+                        send_bulk();
+                        purge_chunks(std::move(op));
+                    }
+                }
+
+                send_bulk();
+
+                if(!deferred.empty()) {
+                    queue_.hold(std::move(deferred));
+                }
+            }
+
+        } // run
+
+    private:
+        static bool is_transient(const long _status)
+        {
+            return 0 == _status || 429 == _status || _status >= 500;
+        }
+
+        void fail(const std::string& _reason)
+        {
+            ++counters.failed;
+            log("ERROR", _reason);
+        }
+
+        void retry(operation&& _op, const std::string& _reason)
+        {
+            if(++_op.attempts > config_.max_retries) {
+                fail(fmt::format("dropping operation after {} attempts [{}] [{}]"
+                    , _op.attempts
+                    , _reason
+                    , _op.first));
+                return;
+            }
+
+            ++counters.retried;
+            retried_.insert(_op.key);
+
+            const auto delay = config_.retry_backoff_ms * (1u << std::min(_op.attempts - 1, 10u));
+            queue_.retry(std::move(_op), std::chrono::milliseconds{delay});
+
+        } // retry
+
+        void perform_bulk(std::vector<operation>&& _ops)
+        {
+            std::string body;
+            for(auto&& op : _ops) {
+                body += op.first;
+                body += '\n';
+                if(!op.second.empty()) {
+                    body += op.second;
+                    body += '\n';
+                }
+            }
+
+            const cpr::Response response = client_.performRequest(
+                                               elasticlient::Client::HTTPMethod::POST
+                                             , "_bulk"
+                                             , body);
+
+            if(200 != response.status_code) {
+                const auto reason = fmt::format("bulk failed code [{}] message [{}]"
+                                        , response.status_code
+                                        , response.text);
+                for(auto&& op : _ops) {
+                    if(is_transient(response.status_code)) {
+                        retry(std::move(op), reason);
+                    }
+                    else {
+                        fail(fmt::format("dropping operation [{}] [{}]", reason, op.first));
+                    }
+                }
+                return;
+            }
+
+            uint64_t failed{};
+
+            try {
+                // each operation is a single action, so the position of a
+                // failed item is that of its operation
+                for(auto&& f : idx::get_bulk_failures(response.text)) {
+                    if(f.position >= _ops.size()) {
+                        continue;
+                    }
+
+                    ++failed;
+
+                    const auto reason = fmt::format("[{}] [{}] [{}]", f.status, f.type, f.reason);
+                    if(is_transient(f.status)) {
+                        retry(std::move(_ops[f.position]), reason);
+                    }
+                    else {
+                        fail(fmt::format("{} of [{}] in [{}] failed {}", f.action, f.id, f.index, reason));
+                    }
+                }
+            }
+            catch(const json::exception& _e) {
+                log("ERROR", fmt::format("failed to parse bulk response [{}]", _e.what()));
+            }
+
+            counters.sent += _ops.size() - std::min<uint64_t>(failed, _ops.size());
+
+        } // perform_bulk
+
+        // chunk documents are numbered contiguously from zero, delete them a
+        // bulk at a time until a bulk finds a chunk which does not exist
+        void purge_chunks(operation&& _op)
+        {
+            for(uint64_t first = 0; ; first += config_.bulk_count) {
+                std::string body;
+                for(uint64_t i = first; i < first + config_.bulk_count; ++i) {
+                    body += fmt::format(
+                                "{{\"delete\":{{\"_index\":\"{}\",\"_type\":\"text\",\"_id\":\"{}::{}\"{}}}}}\n"
+                                , _op.first
+                                , _op.second
+                                , i
+                                , _op.routing.empty()
+                                  ? std::string{}
+                                  : fmt::format(",\"routing\":\"{}\"", _op.routing));
+                }
+
+                const cpr::Response response = client_.performRequest(
+                                                   elasticlient::Client::HTTPMethod::POST
+                                                 , "_bulk"
+                                                 , body);
+                if(200 != response.status_code) {
+                    const auto reason = fmt::format("purge failed code [{}] message [{}]"
+                                            , response.status_code
+                                            , response.text);
+                    if(is_transient(response.status_code)) {
+                        retry(std::move(_op), reason);
+                    }
+                    else {
+                        fail(reason);
+                    }
+                    return;
+                }
+
+                try {
+                    for(auto&& i : json::parse(response.text).at("items")) {
+                        if(404 == i.at("delete").value("status", 0L)) {
+                            ++counters.sent;
+                            return;
+                        }
+                    }
+                }
+                catch(const json::exception& _e) {
+                    log("ERROR", fmt::format("failed to parse purge response [{}]", _e.what()));
+                    return;
+                }
+            }
+
+        } // purge_chunks
+
+        const configuration&      config_;
+        operation_queue&          queue_;
+        idx::elasticsearch_client client_;
+        // the keys of the current batch with an operation waiting to retry
+        std::set<std::string>     retried_;
+
+    }; // class sender
+
+    int listen_on(const std::string& _path)
+    {
+        sockaddr_un addr{};
+        if(_path.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error{fmt::format("socket path is too long [{}]", _path)};
+        }
+
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, _path.c_str(), sizeof(addr.sun_path) - 1);
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0) {
+            throw std::runtime_error{fmt::format("socket failed [{}]", std::strerror(errno))};
+        }
+
+        ::unlink(_path.c_str());
+
+        if(::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+           || ::chmod(_path.c_str(), S_IRUSR | S_IWUSR) < 0
+           || ::listen(fd, SOMAXCONN) < 0) {
+            const auto msg = fmt::format("failed to listen on [{}] [{}]", _path, std::strerror(errno));
+            ::close(fd);
+            throw std::runtime_error{msg};
+        }
+
+        return fd;
+
+    } // listen_on
+
+    // logged, and written as json to the metrics path when one is configured
+    void report_metrics(const configuration& _config, queue_set& _queues)
+    {
+        uint64_t pending{};
+        for(auto&& q : _queues) {
+            pending += q->pending();
+        }
+
+        const json m{
+            {"received", counters.received.load()},
+            {"sent",     counters.sent.load()},
+            {"retried",  counters.retried.load()},
+            {"failed",   counters.failed.load()},
+            {"pending",  pending}};
+
+        log("NOTICE", fmt::format("metrics {}", m.dump()));
+
+        if(_config.metrics_path.empty()) {
+            return;
+        }
+
+        const auto temp = _config.metrics_path + ".tmp";
+        {
+            std::ofstream out{temp, std::ios::trunc};
+            out << m.dump() << '\n';
+            if(!out) {
+                log("ERROR", fmt::format("failed to write metrics [{}]", temp));
+                return;
+            }
+        }
+
+        std::rename(temp.c_str(), _config.metrics_path.c_str());
+
+    } // report_metrics
+
+    void handle_signal(int)
+    {
+        running = false;
+    }
+
+    void log_fcn(elasticlient::LogLevel lvl, const std::string& msg)
+    {
+        if(lvl == elasticlient::LogLevel::ERROR) {
+            log("ERROR", fmt::format("ELASTICLIENT :: [{}]", msg));
+        }
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string config_path{"/etc/irods/indexing_daemon.json"};
+    for(int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i]};
+        if(("-c" == arg || "--config" == arg) && i + 1 < argc) {
+            config_path = argv[++i];
+        }
+        else {
+            std::cerr << "usage: " << argv[0] << " [--config <path>]" << std::endl;
+            return 1;
+        }
+    }
+
+    struct sigaction sa{};
+    sa.sa_handler = handle_signal;
+    ::sigaction(SIGINT,  &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    elasticlient::setLogFunction(log_fcn);
+    idx::host_selector::instance().set_log_function(
+        [](const std::string& _msg) { log("NOTICE", _msg); });
+
+    try {
+        const auto config = load_configuration(config_path);
+
+        // each sender has its own queue, the limit is shared among them
+        const auto sender_count = std::max(config.senders, 1u);
+
+        queue_set queues;
+        for(uint32_t i = 0; i < sender_count; ++i) {
+            queues.push_back(std::make_unique<operation_queue>(
+                std::max<uint64_t>(config.max_queue / sender_count, 1)));
+        }
+
+        std::vector<std::thread> senders;
+        for(auto&& q : queues) {
+            senders.emplace_back([&config, &queue = *q] {
+                sender{config, queue}.run();
+            });
+        }
+
+        connection_set connections{queues};
+
+        const int listen_fd = listen_on(config.socket_path);
+        log("NOTICE", fmt::format("listening on [{}]", config.socket_path));
+
+        auto next_report = clock_type::now() + std::chrono::milliseconds{config.metrics_interval_ms};
+
+        while(running) {
+            if(config.metrics_interval_ms > 0 && clock_type::now() >= next_report) {
+                report_metrics(config, queues);
+                next_report = clock_type::now() + std::chrono::milliseconds{config.metrics_interval_ms};
+            }
+
+            pollfd pfd{listen_fd, POLLIN, 0};
+            if(::poll(&pfd, 1, 1000) <= 0) {
+                continue;
+            }
+
+            const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if(fd < 0) {
+                continue;
+            }
+
+            connections.add(fd);
+        }
+
+        log("NOTICE", "shutting down, flushing pending operations");
+
+        ::close(listen_fd);
+        ::unlink(config.socket_path.c_str());
+
+        // every frame received is queued before the queues are stopped
+        connections.close_all();
+
+        for(auto&& q : queues) {
+            q->stop();
+        }
+
+        for(auto&& t : senders) {
+            t.join();
+        }
+
+        report_metrics(config, queues);
+    }
+    catch(const std::exception& _e) {
+        log("ERROR", _e.what());
+        return 1;
+    }
+
+    return 0;
+
+} // main
@@ -3,121 +3,574 @@
 #define IRODS_FILESYSTEM_ENABLE_SERVER_SIDE_API
 
 #include "utilities.hpp"
+#include "backfill.hpp"
+#include "bulk.hpp"
+#include "bulk_load.hpp"
+#include "rollover.hpp"
+#include "checksum.hpp"
+#include "rename.hpp"
+#include "reconciliation.hpp"
 
 #include "policy_composition_framework_configuration_manager.hpp"
 #include "policy_composition_framework_parameter_capture.hpp"
+#include "policy_composition_framework_keywords.hpp"
 
 #include "transport/default_transport.hpp"
 #include "dstream.hpp"
 
 #include "cpr/response.h"
 #include "elasticlient/client.h"
-#include "elasticlient/bulk.h"
 #include "elasticlient/logging.h"
 
 #include "fmt/format.h"
 
+#include <optional>
+
 namespace {
     namespace pe   = irods::policy_composition::policy_engine;
+    namespace kw   = irods::policy_composition::keywords;
     namespace idx  = irods::indexing;
     namespace fs   = irods::experimental::filesystem;
     namespace fsvr = irods::experimental::filesystem::server;
 
-    irods::error index_fulltext(
-          rsComm_t*                             comm
-        , std::shared_ptr<elasticlient::Client> client
-        , const uint64_t                        read_size
-        , const uint32_t                        bulk_count
-        , const std::string&                    logical_path
-        , const std::string&                    index_name
-        , const bool                            log_verbose) {
+    using indexed_checksums = std::map<std::pair<std::string, std::string>, std::string>;
+    using duplicate_sources = std::map<std::pair<std::string, std::string>, std::string>;
+
+    // what the indices already hold of the content of a batch of objects,
+    // keyed by index name and object id: the checksum recorded for each
+    // object, and the id of another object with the same content
+    struct indexed_content {
+        indexed_checksums checksums;
+        duplicate_sources duplicates;
+    };
+
+    // read the object once in read_size chunks, sanitize each chunk and add
+    // it to the bulk for every index.  content kept while computing its
+    // checksum is used rather than reading the object again.  the bulk is performed whenever it
+    // reaches bulk_count documents, documents left in the bulk are the
+    // responsibility of the caller so that a bulk may span many objects.
+    irods::error index_fulltext_chunks(
+          rsComm_t*                       comm
+        , idx::bulk_request&              bulk
+        , const uint64_t                  read_size
+        , const idx::object_entry&        object
+        , const std::vector<std::string>& index_names
+        , const idx::qos_policy&          qos
+        , const bool                      route_by_object_id
+        , const bool                      log_verbose) {
+
+        const auto& logical_path = object.logical_path;
 
         if(log_verbose) {
-            rodsLog(
-                LOG_NOTICE
-              , "indexing full text in [%s] for path [%s]"
-              , index_name.c_str()
-              , logical_path.c_str());
+            for(auto&& index_name : index_names) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "indexing full text in [%s] for path [%s]"
+                  , index_name.c_str()
+                  , logical_path.c_str());
+            }
         }
 
-        const std::string object_id{idx::get_id_for_logical_path(comm, logical_path)};
+        // reused from one object to the next, as is the bulk body into
+        // which each chunk is written directly
+        thread_local std::string read_buff;
+        read_buff.resize(read_size);
 
-        elasticlient::Bulk bulkIndexer(client);
-        elasticlient::SameIndexBulkData bulk(index_name, bulk_count);
+        idx::span s{"read_object"};
+        s.set("logical_path", logical_path);
 
-        auto file_size = fsvr::data_object_size(*comm, logical_path);
+        // time spent in each stage, summed over the chunks
+        int64_t read_ns{};
+        int64_t throttle_ns{};
+        int64_t sanitize_ns{};
 
-        // TODO:: compute bulk count vs read size
-        auto foo_size{file_size / bulk_count};
+        auto lap = [mark = idx::trace::now_ns()](int64_t& _total) mutable {
+            const auto now = idx::trace::now_ns();
+            _total += now - mark;
+            mark = now;
+        };
 
-        char read_buff[foo_size];
-        irods::experimental::io::server::basic_transport<char> xport(*comm);
-        irods::experimental::io::idstream ds{xport, logical_path};
+        const auto& content = object.content;
+
+        std::optional<idx::object_reader> reader;
+        if(content.empty()) {
+            reader.emplace(comm, logical_path);
+        }
 
         int chunk_counter{0};
-        bool need_final_perform{false};
-        while(ds) {
-            ds.read(read_buff, foo_size);
-            std::string data{read_buff};
-
-            data.erase(
-                std::remove_if(
-                    data.begin(),
-                    data.end(),
-                [](wchar_t c) { return (std::iscntrl(c) ||
-                                        c == '"'        ||
-                                        c == '\''       ||
-                                        c == '\\');}),
-                    data.end());
-
-            std::string cleaned{idx::correct_non_utf_8(&data)};
-
-            std::string index_id{
-                            fmt::format(
-                            "{}{}{}"
-                            , object_id
-                            , idx::indexer_separator
-                            , chunk_counter)};
-            ++chunk_counter;
+        uint64_t bytes_read{};
+        while(!reader || *reader) {
+            const auto count = reader
+                               ? reader->read(read_buff.data(), read_size)
+                               : static_cast<std::streamsize>(content.copy(read_buff.data(), read_size, bytes_read));
+            lap(read_ns);
+            if(count <= 0) {
+                break;
+            }
 
-            std::string payload{
-                            fmt::format(
-                            "{{ \"logical_path\" : \"{}\", \"data\" : \"{}\" }}"
-                            , logical_path
-                            , cleaned)};
+            // the leading bytes of every object go one class ahead, so that
+            // small objects are not held up behind large ones.  kept content
+            // was throttled as it was read.
+            if(reader) {
+                idx::qos_limiter::instance().throttle_read(
+                    qos.config
+                  , bytes_read < qos.config.small_object_size ? idx::promote(qos.priority) : qos.priority
+                  , count);
+            }
+            bytes_read += count;
+            lap(throttle_ns);
+
+            // filtered in place within the read buffer
+            const auto data_end = std::remove_if(
+                                      read_buff.begin(),
+                                      read_buff.begin() + count,
+                                  [](wchar_t c) { return (std::iscntrl(c) ||
+                                                          c == '"'        ||
+                                                          c == '\''       ||
+                                                          c == '\\');});
+            const auto data_size = static_cast<std::size_t>(data_end - read_buff.begin());
+
+            const auto index_id = fmt::format(
+                                      "{}{}{}"
+                                      , object.id
+                                      , idx::indexer_separator
+                                      , chunk_counter);
+
+            // the corrected data of the first document is copied for the rest
+            std::size_t data_offset{};
+            std::size_t data_length{};
+
+            bool done{false};
+            for(auto&& index_name : index_names) {
+                auto& body = bulk.begin_document(
+                                 index_name
+                               , index_id
+                               , idx::get_routing(route_by_object_id, object.id));
+
+                fmt::format_to(
+                    std::back_inserter(body)
+                  , "{{ \"logical_path\" : \"{}\", \"object_id\" : {}, \"chunk\" : {}, \"data\" : \""
+                  , logical_path
+                  , object.id
+                  , chunk_counter);
+
+                if(0 == data_length) {
+                    data_offset = body.size();
+                    idx::append_utf_8(body, read_buff.data(), data_size);
+                    data_length = body.size() - data_offset;
+                }
+                else {
+                    body.append(body, data_offset, data_length);
+                }
+
+                body += "\" }";
+
+                done = bulk.end_document();
+            }
+            ++chunk_counter;
+            lap(sanitize_ns);
 
-            need_final_perform = true;
-            bool done = bulk.indexDocument("text", index_id, payload.data());
             if(done) {
-                need_final_perform = false;
-                // have reached bulk_count chunks
-                auto error_count = bulkIndexer.perform(bulk);
-                bulk.clear();
-                if(error_count > 0) {
-                    return ERROR(
-                               SYS_INTERNAL_ERR,
-                               fmt::format("Encountered {} errors when indexing [{}]"
-                                , error_count
-                                , logical_path));
+                // have reached bulk_count documents
+                auto err = bulk.perform(logical_path);
+                if(!err.ok()) {
+                    s.set_error(err.result());
+                    return err;
                 }
+
+                // the bulk has a span of its own
+                int64_t bulk_ns{};
+                lap(bulk_ns);
             }
         } // while
 
-        if(need_final_perform) {
-            auto error_count = bulkIndexer.perform(bulk);
-            bulk.clear();
-            if(error_count > 0) {
-                return ERROR(
-                           SYS_INTERNAL_ERR,
-                           fmt::format("Encountered {} errors when indexing [{}]"
-                            , error_count
-                            , logical_path));
-            }
+        s.set("bytes",       bytes_read);
+        s.set("chunks",      chunk_counter);
+        s.set("read_ms",     read_ns / 1000000);
+        s.set("throttle_ms", throttle_ns / 1000000);
+        s.set("sanitize_ms", sanitize_ns / 1000000);
+
+        return SUCCESS();
+
+    } // index_fulltext_chunks
+
+    // skip the indices which already hold this content and satisfy the rest
+    // from an identical object where possible, reading the object only for
+    // the indices which remain.  the checksum of each index written is added
+    // to the markers, for the caller to record once the bulks are flushed.
+    irods::error index_fulltext_object(
+          rsComm_t*                          comm
+        , idx::elasticsearch_client&         client
+        , idx::bulk_request&                 bulk
+        , const uint64_t                     read_size
+        , const uint32_t                     bulk_count
+        , const idx::object_entry&           object
+        , const std::vector<std::string>&    index_names
+        , const indexed_content&             indexed
+        , const idx::qos_policy&             qos
+        , const bool                         route_by_object_id
+        , const bool                         log_verbose
+        , std::vector<idx::object_checksum>& markers) {
+
+        std::vector<std::string> targets;
+
+        if(object.checksum.empty()) {
+            targets = index_names;
+        }
+        else {
+            for(auto&& index_name : index_names) {
+                auto unchanged = indexed.checksums.find({index_name, object.id});
+                if(unchanged != indexed.checksums.end() && unchanged->second == object.checksum) {
+                    if(log_verbose) {
+                        rodsLog(
+                            LOG_NOTICE
+                          , "skipping unchanged full text in [%s] for path [%s]"
+                          , index_name.c_str()
+                          , object.logical_path.c_str());
+                    }
+
+                    continue;
+                }
+
+                auto duplicate = indexed.duplicates.find({index_name, object.id});
+                if(duplicate != indexed.duplicates.end()
+                   && idx::copy_duplicate_chunks(
+                          client
+                        , bulk
+                        , bulk_count
+                        , index_name
+                        , object.id
+                        , object.logical_path
+                        , duplicate->second
+                        , route_by_object_id)) {
+                    if(log_verbose) {
+                        rodsLog(
+                            LOG_NOTICE
+                          , "copied duplicate full text in [%s] for path [%s]"
+                          , index_name.c_str()
+                          , object.logical_path.c_str());
+                    }
+
+                    markers.push_back({index_name, object.id, object.checksum});
+
+                    continue;
+                }
+
+                // neither held already nor copied, the object is read
+                targets.push_back(index_name);
+            } // for index_name
+        }
+
+        if(targets.empty()) {
+            return SUCCESS();
+        }
+
+        auto err = index_fulltext_chunks(
+                       comm
+                     , bulk
+                     , read_size
+                     , object
+                     , targets
+                     , qos
+                     , route_by_object_id
+                     , log_verbose);
+        if(!err.ok() || object.checksum.empty()) {
+            return err;
+        }
+
+        for(auto&& index_name : targets) {
+            markers.push_back({index_name, object.id, object.checksum});
         }
 
         return SUCCESS();
+
+    } // index_fulltext_object
+
+    // fill in missing checksums as the mode requires, fetch the checksums
+    // already recorded in the indices for all of the objects, and find the
+    // objects holding the same content as those which have changed.  up to
+    // keep bytes of the content read to compute checksums are kept.
+    //
+    // the daemon does not report whether the chunks it was handed were
+    // applied, so the recorded checksums can not be trusted once it is in
+    // use and every object is read.
+    indexed_content prepare_checksums(
+          rsComm_t*                       comm
+        , idx::elasticsearch_client&      client
+        , const uint64_t                  read_size
+        , const uint64_t                  keep_bytes
+        , const std::string&              checksum_mode
+        , const std::string&              daemon_socket
+        , idx::object_batch&              batch
+        , const std::vector<std::string>& index_names
+        , const idx::qos_policy&          qos
+        , const bool                      route_by_object_id) {
+
+        if(idx::checksum_mode::none == checksum_mode) {
+            for(auto&& obj : batch) {
+                obj.checksum.clear();
+            }
+
+            return {};
+        }
+
+        if(!daemon_socket.empty()) {
+            return {};
+        }
+
+        std::vector<std::string> ids;
+
+        uint64_t kept{};
+
+        for(auto&& obj : batch) {
+            if(obj.checksum.empty() && idx::checksum_mode::compute == checksum_mode) {
+                try {
+                    obj.checksum = idx::compute_checksum(
+                                       comm
+                                     , obj.logical_path
+                                     , read_size
+                                     , qos
+                                     , obj.content
+                                     , keep_bytes - kept);
+                    kept += obj.content.size();
+                }
+                catch(const irods::exception& e) {
+                    rodsLog(
+                        LOG_ERROR
+                      , "failed to compute checksum for [%s] [%s]"
+                      , obj.logical_path.c_str()
+                      , e.what());
+                }
+            }
+
+            if(!obj.checksum.empty()) {
+                ids.push_back(obj.id);
+            }
+        }
+
+        indexed_content indexed{
+            idx::get_indexed_checksums(client, index_names, ids, route_by_object_id)
+          , {}};
+
+        std::vector<idx::object_checksum> changed;
+
+        for(auto&& obj : batch) {
+            if(obj.checksum.empty()) {
+                continue;
+            }
+
+            for(auto&& index_name : index_names) {
+                auto it = indexed.checksums.find({index_name, obj.id});
+                if(it == indexed.checksums.end() || it->second != obj.checksum) {
+                    changed.push_back({index_name, obj.id, obj.checksum});
+                }
+            }
+        }
+
+        indexed.duplicates = idx::find_duplicate_sources(client, changed);
+
+        return indexed;
+
+    } // prepare_checksums
+
+    irods::error index_fulltext(
+          rsComm_t*                                  comm
+        , std::shared_ptr<idx::elasticsearch_client> client
+        , const uint64_t                             read_size
+        , const uint64_t                             keep_bytes
+        , const uint32_t                             bulk_count
+        , const std::string&                         daemon_socket
+        , const std::string&                         checksum_mode
+        , const std::string&                         logical_path
+        , const std::vector<std::string>&            index_names
+        , const idx::qos_policy&                     qos
+        , const bool                                 route_by_object_id
+        , const bool                                 log_verbose) {
+
+        idx::object_batch batch{{
+            idx::get_id_for_logical_path(comm, logical_path)
+          , logical_path
+          , idx::checksum_mode::none == checksum_mode
+            ? std::string{}
+            : idx::get_checksum_for_logical_path(comm, logical_path)}};
+
+        const auto indexed = prepare_checksums(
+                                 comm
+                               , *client
+                               , read_size
+                               , keep_bytes
+                               , checksum_mode
+                               , daemon_socket
+                               , batch
+                               , index_names
+                               , qos
+                               , route_by_object_id);
+
+        idx::bulk_request bulk{client, bulk_count, daemon_socket, qos};
+
+        std::vector<idx::object_checksum> markers;
+
+        auto err = index_fulltext_object(
+                         comm
+                       , *client
+                       , bulk
+                       , read_size
+                       , bulk_count
+                       , batch.front()
+                       , index_names
+                       , indexed
+                       , qos
+                       , route_by_object_id
+                       , log_verbose
+                       , markers);
+        if(!err.ok()) {
+            return err;
+        }
+
+        err = bulk.flush(logical_path);
+        if(!err.ok()) {
+            return err;
+        }
+
+        // chunks handed to the daemon may yet fail, they are not marked
+        if(bulk.delegated()) {
+            return SUCCESS();
+        }
+
+        return idx::write_checksum_markers(bulk, markers, logical_path, route_by_object_id);
+
     } // index_fulltext
 
+    // index a batch of objects from a collection backfill, sharing one client
+    // and one bulk across all of them.  returns the number of failed objects.
+    uint64_t index_fulltext_batch(
+          rsComm_t*                        comm
+        , const idx::client_configuration& hosts
+        , const uint64_t                   read_size
+        , const uint64_t                   keep_bytes
+        , const uint32_t                   bulk_count
+        , const std::string&               daemon_socket
+        , const std::string&               checksum_mode
+        , idx::object_batch                batch
+        , const std::vector<std::string>&  index_names
+        , const idx::qos_policy&           qos
+        , const bool                       route_by_object_id
+        , const bool                       log_verbose) {
+
+        auto client = std::make_shared<idx::elasticsearch_client>(hosts);
+
+        const auto indexed = prepare_checksums(
+                                 comm
+                               , *client
+                               , read_size
+                               , keep_bytes
+                               , checksum_mode
+                               , daemon_socket
+                               , batch
+                               , index_names
+                               , qos
+                               , route_by_object_id);
+
+        idx::bulk_request bulk{client, bulk_count, daemon_socket, qos};
+
+        uint64_t failed{};
+
+        std::vector<idx::object_checksum> markers;
+
+        for(auto&& obj : batch) {
+            auto err = index_fulltext_object(
+                             comm
+                           , *client
+                           , bulk
+                           , read_size
+                           , bulk_count
+                           , obj
+                           , index_names
+                           , indexed
+                           , qos
+                           , route_by_object_id
+                           , log_verbose
+                           , markers);
+            if(!err.ok()) {
+                rodsLog(LOG_ERROR, "%s", err.result().c_str());
+                ++failed;
+            }
+        } // for obj
+
+        auto err = bulk.flush(batch.back().logical_path);
+        if(!err.ok()) {
+            rodsLog(LOG_ERROR, "%s", err.result().c_str());
+            ++failed;
+        }
+
+        // a failed bulk may have held the chunks of any object in the batch,
+        // none is marked and all are read again by the next run.  nor are
+        // chunks handed to the daemon, which may yet fail.
+        if(failed > 0 || bulk.delegated()) {
+            return failed;
+        }
+
+        err = idx::write_checksum_markers(bulk, markers, batch.back().logical_path, route_by_object_id);
+        if(!err.ok()) {
+            rodsLog(LOG_ERROR, "%s", err.result().c_str());
+            ++failed;
+        }
+
+        return failed;
+
+    } // index_fulltext_batch
+
+    // compare a collection in the catalog with the full text indices which
+    // apply to it and repair any differences, or only report them
+    irods::error full_text_reconcile_elasticsearch(const pe::context& ctx)
+    {
+        // clang-format off
+        const auto cfg_mgr     = pe::configuration_manager{ctx.instance_name, ctx.configuration};
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
+        const auto log_verbose = std::string{"true"} == cfg_mgr.get("log_errors", std::string{"false"});
+        const auto read_size   = cfg_mgr.get("read_size", uint64_t{4194304});
+        const auto keep_bytes  = cfg_mgr.get("checksum_buffer_size", uint64_t{67108864});
+        const auto bulk_count  = cfg_mgr.get("bulk_count", uint32_t{100});
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto cksum_mode  = idx::get_checksum_mode(cfg_mgr);
+        const auto route_by_id = idx::routing_mode::object_id == idx::get_routing_mode(cfg_mgr);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg_mgr);
+        const auto index_cfg   = idx::get_index_configuration(cfg_mgr);
+        // clang-format on
+
+        idx::span root{idx::get_tracing_configuration(cfg_mgr), "full_text_reconcile"};
+        root.set("logical_path", ctx.parameters.at("logical_path").get<std::string>());
+
+        auto client = std::make_shared<idx::elasticsearch_client>(hosts);
+
+        return idx::reconcile_collection(
+                     ctx.rei->rsComm
+                   , *client
+                   , cfg_mgr
+                   , ctx.parameters.at("logical_path").get<std::string>()
+                   , idx::it::full_text
+                   , idx::is_dry_run(ctx.parameters)
+                   , log_verbose
+                   , [&](const std::string& index_name, const std::string& path) {
+                       idx::prepare_indices(*client, index_cfg, index_name, idx::it::full_text);
+
+                       return index_fulltext(
+                                    ctx.rei->rsComm
+                                  , client
+                                  , read_size
+                                  , keep_bytes
+                                  , bulk_count
+                                  , daemon_sock
+                                  , cksum_mode
+                                  , path
+                                  , std::vector<std::string>{index_name}
+                                  , idx::qos_policy{qos_cfg, idx::qos_priority::low}
+                                  , route_by_id
+                                  , log_verbose);
+                   });
+
+    } // full_text_reconcile_elasticsearch
+
     void log_fcn(elasticlient::LogLevel lvl, const std::string& msg) {
         if(lvl == elasticlient::LogLevel::ERROR) {
             rodsLog(LOG_ERROR, "ELASTICLIENT :: [%s]", msg.c_str());
@@ -126,35 +579,159 @@ namespace {
 
     irods::error full_text_index_elasticsearch(const pe::context& ctx, pe::arg_type out)
     {
-        if(idx::event_is_invalid(ctx.parameters, {"put", "write", "metadata"})) {
+        if(idx::is_reconcile(ctx.parameters)) {
+            elasticlient::setLogFunction(log_fcn);
+            return full_text_reconcile_elasticsearch(ctx);
+        }
+
+        if(idx::event_is_invalid(ctx.parameters, {"put", "write", "metadata", "rename"})) {
             return SUCCESS();
         }
 
         // clang-format off
         const auto cfg_mgr     = pe::configuration_manager{ctx.instance_name, ctx.configuration};
         const auto event       = std::string{ctx.parameters.at("event")};
-        const auto hosts       = cfg_mgr.get("hosts", std::vector<std::string>{});
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
         const auto log_verbose = std::string{"true"} == cfg_mgr.get("log_errors", std::string{"false"});
         const auto read_size   = cfg_mgr.get("read_size", uint64_t{4194304});
+        const auto keep_bytes  = cfg_mgr.get("checksum_buffer_size", uint64_t{67108864});
         const auto bulk_count  = cfg_mgr.get("bulk_count", uint32_t{100});
-        const auto index_name  = idx::get_index_name(ctx.parameters);
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto cksum_mode  = idx::get_checksum_mode(cfg_mgr);
+        const auto route_by_id = idx::routing_mode::object_id == idx::get_routing_mode(cfg_mgr);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg_mgr);
+        const auto index_cfg   = idx::get_index_configuration(cfg_mgr);
         // clang-format on
 
+        idx::span root{idx::get_tracing_configuration(cfg_mgr), "full_text_index"};
+        root.set("event", event);
+
+        elasticlient::setLogFunction(log_fcn);
+
+        std::shared_ptr<idx::elasticsearch_client> client =
+            std::make_shared<idx::elasticsearch_client>(hosts);
+
+        auto backfill = [&](const std::string& collection, const std::string& index_name) {
+            idx::prepare_indices(*client, index_cfg, index_name, idx::it::full_text);
+
+            // held until the backfill returns, however it ends
+            idx::bulk_load load{*client, idx::get_bulk_load_configuration(cfg_mgr), index_name};
+
+            return idx::run_backfill(
+                         ctx.rei->rsComm
+                       , collection
+                       , index_name
+                       , idx::get_backfill_configuration(cfg_mgr)
+                       , idx::checkpoint{
+                             ctx.rei->rsComm
+                           , idx::get_checkpoint_configuration(cfg_mgr)
+                           , collection
+                           , index_name
+                           , idx::it::full_text}
+                       , [&](const idx::object_batch& batch) {
+                           return index_fulltext_batch(
+                                        ctx.rei->rsComm
+                                      , hosts
+                                      , read_size
+                                      , keep_bytes
+                                      , bulk_count
+                                      , daemon_sock
+                                      , cksum_mode
+                                      , batch
+                                      , std::vector<std::string>{index_name}
+                                      , idx::qos_policy{qos_cfg, idx::qos_priority::low}
+                                      , route_by_id
+                                      , log_verbose);
+                       });
+        };
+
+        if("RENAME" == event) {
+            const auto [source, destination] = idx::get_rename_paths(ctx.parameters);
+
+            // content only needs to be read for indices which did not
+            // already hold it under the old path
+            return idx::handle_rename(
+                         ctx.rei->rsComm
+                       , *client
+                       , idx::get_query_task_configuration(cfg_mgr)
+                       , idx::it::full_text
+                       , source
+                       , destination
+                       , log_verbose
+                       , [&](const std::string& path, bool is_collection, const std::vector<std::string>& index_names) {
+                           if(!is_collection) {
+                               idx::prepare_indices(*client, index_cfg, index_names, idx::it::full_text);
+
+                               return index_fulltext(
+                                            ctx.rei->rsComm
+                                          , client
+                                          , read_size
+                                          , keep_bytes
+                                          , bulk_count
+                                          , daemon_sock
+                                          , cksum_mode
+                                          , path
+                                          , index_names
+                                          , idx::qos_policy{qos_cfg, idx::qos_priority::normal}
+                                          , route_by_id
+                                          , log_verbose);
+                           }
+
+                           irods::error last_error = SUCCESS();
+                           for(auto&& index_name : index_names) {
+                               auto err = backfill(path, index_name);
+                               if(!err.ok()) {
+                                   last_error = err;
+                               }
+                           }
+
+                           return last_error;
+                       });
+        }
+
+        const auto index_name = idx::get_index_name(ctx.parameters);
+
         auto [un, logical_path, sr, dr] =
             capture_parameters(ctx.parameters, tag_first_resc);
 
-        elasticlient::setLogFunction(log_fcn);
+        if(idx::is_collection_backfill(ctx.rei->rsComm, ctx.parameters, logical_path)) {
+            const auto [a, v, u, operation, e, t] =
+                idx::extract_all(ctx.parameters.at(kw::metadata));
+            if(kw::set != operation && kw::add != operation) {
+                return SUCCESS();
+            }
 
-        std::shared_ptr<elasticlient::Client> client =
-            std::make_shared<elasticlient::Client>(hosts);
+            return backfill(logical_path, index_name);
+        }
+
+        // an object may fall under several collections tagged for full text
+        // indexing, unless the event is the application of one of those tags
+        // read the object once and write it to all of them
+        auto index_names = std::vector<std::string>{index_name};
+        if("METADATA" != event) {
+            index_names = idx::get_index_names_for_path(
+                              ctx.rei->rsComm
+                            , logical_path
+                            , idx::it::full_text);
+            if(index_names.empty()) {
+                index_names.push_back(index_name);
+            }
+        }
+
+        idx::prepare_indices(*client, index_cfg, index_names, idx::it::full_text);
 
         return index_fulltext(
                      ctx.rei->rsComm
                    , client
                    , read_size
+                   , keep_bytes
                    , bulk_count
+                   , daemon_sock
+                   , cksum_mode
                    , logical_path
-                   , index_name
+                   , index_names
+                   , idx::qos_policy{qos_cfg, idx::qos_priority::normal}
+                   , route_by_id
                    , log_verbose);
 
         return SUCCESS();
@@ -204,6 +781,9 @@ pe::plugin_pointer_type plugin_factory(
       const std::string& _plugin_name
     , const std::string&) {
 
+    idx::host_selector::instance().set_log_function(
+        [](const std::string& _msg) { rodsLog(LOG_NOTICE, "%s", _msg.c_str()); });
+
     return pe::make(
                  _plugin_name
                , "irods_policy_indexing_full_text_index_elasticsearch"
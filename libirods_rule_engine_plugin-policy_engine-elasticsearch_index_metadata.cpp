@@ -1,5 +1,13 @@
 
 #include "utilities.hpp"
+#include "attribute_filter.hpp"
+#include "backfill.hpp"
+#include "bulk.hpp"
+#include "bulk_load.hpp"
+#include "rollover.hpp"
+#include "metadata_layout.hpp"
+#include "rename.hpp"
+#include "reconciliation.hpp"
 
 #include "policy_composition_framework_configuration_manager.hpp"
 #include "policy_composition_framework_parameter_capture.hpp"
@@ -7,7 +15,6 @@
 
 #include "cpr/response.h"
 #include "elasticlient/client.h"
-#include "elasticlient/bulk.h"
 #include "elasticlient/logging.h"
 
 #include "fmt/format.h"
@@ -21,15 +28,36 @@ namespace {
     namespace fsvr = irods::experimental::filesystem::server;
     // clang-format on
 
+    auto make_metadata_payload(
+          const std::string& object_id
+        , const std::string& logical_path
+        , const std::string& attribute
+        , const std::string& value
+        , const std::string& units) {
+
+        return fmt::format(
+                   "{{ \"logical_path\":\"{}\", \"object_id\":{}, \"attribute\":\"{}\", \"value\":\"{}\", \"units\":\"{}\" }}"
+                   , logical_path
+                   , object_id
+                   , attribute
+                   , value
+                   , units);
+
+    } // make_metadata_payload
+
+    // add the avu to the bulk, performing it once bulk_count documents have
+    // been added.  the caller performs whatever remains.
     irods::error index_metadata(
-          rsComm_t*             comm
-        , elasticlient::Client& client
-        , const std::string&    logical_path
-        , const std::string&    index_name
-        , const std::string&    attribute
-        , const std::string&    value
-        , const std::string&    units
-        , const bool            log_verbose) {
+          idx::bulk_request& bulk
+        , const std::string& layout
+        , const std::string& object_id
+        , const std::string& logical_path
+        , const std::string& index_name
+        , const std::string& operation
+        , const std::string& attribute
+        , const std::string& value
+        , const std::string& units
+        , const bool         log_verbose) {
 
         if(log_verbose) {
             rodsLog(
@@ -42,46 +70,70 @@ namespace {
               , logical_path.c_str());
         }
 
-        try {
-            const std::string md_index_id{
-                                  idx::get_metadata_index_id(
-                                      idx::get_id_for_logical_path(
-                                          comm,
-                                          logical_path),
-                                      attribute,
-                                      value,
-                                      units)};
-            std::string payload{
-                            fmt::format(
-                            "{{ \"logical_path\":\"{}\", \"attribute\":\"{}\", \"value\":\"{}\", \"units\":\"{}\" }}"
-                            , logical_path
-                            , attribute
-                            , value
-                            , units)} ;
-
-            const cpr::Response response = client.index(index_name, "text", md_index_id, payload);
-
-            if(log_verbose) {
-                rodsLog(
-                    LOG_NOTICE
-                  , "response code [%d] response text [%s]"
-                  , response.status_code
-                  , response.text.c_str());
+        if(idx::metadata_layout::document_per_object == layout) {
+            if(bulk.update_document(
+                       index_name
+                     , object_id
+                     , idx::make_avu_update(
+                           object_id
+                         , logical_path
+                         , operation
+                         , attribute
+                         , value
+                         , units))) {
+                return bulk.perform(logical_path);
             }
 
-            if(response.status_code != 200 && response.status_code != 201) {
-                return ERROR( SYS_INTERNAL_ERR,
-                    fmt::format(
-                        "failed to index metadata [{}] [{}] [{}] for [{}] code [{}] message [{}]"
-                        , attribute
-                        , value
-                        , units
-                        , logical_path
-                        , response.status_code
-                        , response.text));
+            return SUCCESS();
+        }
+
+        const std::string md_index_id{
+                              idx::get_metadata_index_id(
+                                  object_id,
+                                  attribute,
+                                  value,
+                                  units)};
+
+        if(bulk.index_document(
+                   index_name
+                 , md_index_id
+                 , make_metadata_payload(object_id, logical_path, attribute, value, units))) {
+            return bulk.perform(logical_path);
+        }
+
+        return SUCCESS();
+
+    } // index_metadata
+
+    irods::error index_metadata(
+          rsComm_t*          comm
+        , idx::bulk_request& bulk
+        , const std::string& layout
+        , const std::string& logical_path
+        , const std::string& index_name
+        , const std::string& operation
+        , const std::string& attribute
+        , const std::string& value
+        , const std::string& units
+        , const bool         log_verbose) {
+
+        try {
+            auto err = index_metadata(
+                           bulk
+                         , layout
+                         , idx::get_id_for_logical_path(comm, logical_path)
+                         , logical_path
+                         , index_name
+                         , operation
+                         , attribute
+                         , value
+                         , units
+                         , log_verbose);
+            if(!err.ok()) {
+                return err;
             }
 
-            return SUCCESS();
+            return bulk.flush(logical_path);
         }
         catch(const irods::exception& e) {
             rodsLog(
@@ -95,21 +147,60 @@ namespace {
 
     } // index_metadata
 
-    irods::error index_metadata_for_object(
-          rsComm_t*              comm
-        , elasticlient::Client&  client
-        , const std::string&     logical_path
-        , const std::string&     index_name
-        , const bool             log_verbose) {
+    // add every selected avu of an object to the bulk, as one document
+    // replacing the document of the object or as a document per avu.  an
+    // object without any selected avu has no document in either layout.
+    irods::error index_all_metadata(
+          idx::bulk_request&               bulk
+        , const std::string&               layout
+        , const idx::attribute_filter&     filter
+        , const std::string&               object_id
+        , const std::string&               logical_path
+        , const std::string&               index_name
+        , const std::vector<fs::metadata>& all_avus
+        , const bool                       log_verbose) {
+
+        const auto avus = filter.select(all_avus);
+
+        if(idx::metadata_layout::document_per_object == layout) {
+            if(log_verbose) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "indexing %d avus in [%s] for path [%s]"
+                  , static_cast<int>(avus.size())
+                  , index_name.c_str()
+                  , logical_path.c_str());
+            }
+
+            // whatever was indexed before the avus were removed goes
+            if(avus.empty()) {
+                if(bulk.remove_document(index_name, object_id)) {
+                    return bulk.perform(logical_path);
+                }
+
+                return SUCCESS();
+            }
+
+            if(bulk.index_document(
+                       index_name
+                     , object_id
+                     , idx::make_object_document(object_id, logical_path, avus))) {
+                return bulk.perform(logical_path);
+            }
+
+            return SUCCESS();
+        }
 
         auto last_error = SUCCESS();
 
-        for(auto&& avu : fsvr::get_metadata(*comm, logical_path)) {
+        for(auto&& avu : avus) {
             auto err = index_metadata(
-                             comm
-                           , client
+                             bulk
+                           , layout
+                           , object_id
                            , logical_path
                            , index_name
+                           , kw::add
                            , avu.attribute
                            , avu.value
                            , avu.units
@@ -121,10 +212,311 @@ namespace {
 
         return last_error;
 
+    } // index_all_metadata
+
+    irods::error index_metadata_for_object(
+          rsComm_t*                    comm
+        , idx::bulk_request&           bulk
+        , const std::string&           layout
+        , const idx::attribute_filter& filter
+        , const std::string&           logical_path
+        , const std::string&           index_name
+        , const bool                   log_verbose) {
+
+        auto last_error = SUCCESS();
+
+        std::string object_id{};
+        try {
+            object_id = idx::get_id_for_logical_path(comm, logical_path);
+        }
+        catch(const irods::exception& e) {
+            return ERROR(e.code(), e.what());
+        }
+
+        auto err = index_all_metadata(
+                       bulk
+                     , layout
+                     , filter
+                     , object_id
+                     , logical_path
+                     , index_name
+                     , fsvr::get_metadata(*comm, logical_path)
+                     , log_verbose);
+        if(!err.ok()) {
+            last_error = err;
+        }
+
+        err = bulk.flush(logical_path);
+        if(!err.ok()) {
+            last_error = err;
+        }
+
+        return last_error;
+
     } // index_metadata_for_object
 
+    // index the metadata of a batch of objects from a collection backfill as
+    // bulk requests spanning the whole batch, fetching the avus of each
+    // object unless the batch already holds them.  returns the number of
+    // failed objects.
+    uint64_t index_metadata_batch(
+          rsComm_t*                        comm
+        , const idx::client_configuration& hosts
+        , const uint32_t                   bulk_count
+        , const std::string&               daemon_socket
+        , const std::string&               layout
+        , const idx::attribute_filter&     filter
+        , const idx::object_batch&         batch
+        , const bool                       batch_has_avus
+        , const std::string&               index_name
+        , const idx::qos_policy&           qos
+        , const bool                       log_verbose) {
+
+        idx::bulk_request bulk{
+            std::make_shared<idx::elasticsearch_client>(hosts)
+          , bulk_count
+          , daemon_socket
+          , qos};
+
+        uint64_t failed{};
+
+        auto log_error = [&](const irods::error& err) {
+            rodsLog(LOG_ERROR, "%s", err.result().c_str());
+            ++failed;
+        };
+
+        // the connection is shared with the other threads of the backfill
+        auto get_metadata = [&](const idx::object_entry& obj) {
+            if(batch_has_avus) {
+                return obj.avus;
+            }
+
+            std::lock_guard lk{idx::connection_mutex(comm)};
+            return fsvr::get_metadata(*comm, obj.logical_path);
+        };
+
+        for(auto&& obj : batch) {
+            try {
+                auto err = index_all_metadata(
+                               bulk
+                             , layout
+                             , filter
+                             , obj.id
+                             , obj.logical_path
+                             , index_name
+                             , get_metadata(obj)
+                             , log_verbose);
+                if(!err.ok()) {
+                    log_error(err);
+                }
+            }
+            catch(const irods::exception& e) {
+                rodsLog(
+                    LOG_ERROR
+                  , "failed to get metadata for [%s] [%s]"
+                  , obj.logical_path.c_str()
+                  , e.what());
+                ++failed;
+            }
+        } // for obj
+
+        if(!batch.empty()) {
+            auto err = bulk.flush(batch.back().logical_path);
+            if(!err.ok()) {
+                log_error(err);
+            }
+        }
+
+        return std::min<uint64_t>(failed, batch.size());
+
+    } // index_metadata_batch
+
+    // index every object in a collection, invoked directly
+    irods::error backfill_metadata(
+          const pe::context&               ctx
+        , const pe::configuration_manager& cfg_mgr
+        , const std::string&               collection
+        , const std::string&               index_name) {
+
+        // clang-format off
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
+        const auto bulk_count  = cfg_mgr.get("bulk_count", uint32_t{100});
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto layout      = idx::get_metadata_layout(cfg_mgr);
+        const auto filter      = idx::get_attribute_filter(cfg_mgr);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg_mgr);
+        const auto backfill    = idx::get_backfill_configuration(cfg_mgr);
+        const auto set_based   = idx::avu_extraction::set_based == backfill.avus;
+        const auto log_verbose = std::string{"true"} == cfg_mgr.get(std::string{kw::log_errors}, std::string{"false"});
+        // clang-format on
+
+        idx::elasticsearch_client client{hosts};
+
+        // held until the backfill returns, however it ends
+        idx::bulk_load load{client, idx::get_bulk_load_configuration(cfg_mgr), index_name};
+
+        return idx::run_backfill(
+                     ctx.rei->rsComm
+                   , collection
+                   , index_name
+                   , backfill
+                   , idx::checkpoint{
+                         ctx.rei->rsComm
+                       , idx::get_checkpoint_configuration(cfg_mgr)
+                       , collection
+                       , index_name
+                       , idx::it::metadata}
+                   , [&](const std::string& cursor, auto&& callback) {
+                       if(set_based) {
+                           idx::for_each_object_avu_batch(ctx.rei->rsComm, collection, backfill.batch_size, cursor, callback);
+                       }
+                       else {
+                           idx::for_each_object_batch(ctx.rei->rsComm, collection, backfill.batch_size, cursor, callback);
+                       }
+                   }
+                   , [&](const idx::object_batch& batch) {
+                       return index_metadata_batch(
+                                    ctx.rei->rsComm
+                                  , hosts
+                                  , bulk_count
+                                  , daemon_sock
+                                  , layout
+                                  , *filter
+                                  , batch
+                                  , set_based
+                                  , index_name
+                                  , idx::qos_policy{qos_cfg, idx::qos_priority::low}
+                                  , log_verbose);
+                   });
+
+    } // backfill_metadata
+
+    // move the metadata of a renamed data object or collection to its new
+    // path within the metadata indices
+    irods::error metadata_rename_elasticsearch(const pe::context& ctx)
+    {
+        // clang-format off
+        const auto cfg_mgr     = pe::configuration_manager{ctx.instance_name, ctx.configuration};
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
+        const auto bulk_count  = cfg_mgr.get("bulk_count", uint32_t{100});
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto layout      = idx::get_metadata_layout(cfg_mgr);
+        const auto filter      = idx::get_attribute_filter(cfg_mgr);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg_mgr);
+        const auto index_cfg   = idx::get_index_configuration(cfg_mgr);
+        const auto log_verbose = std::string{"true"} == cfg_mgr.get(std::string{kw::log_errors}, std::string{"false"});
+        // clang-format on
+
+        idx::span root{idx::get_tracing_configuration(cfg_mgr), "metadata_rename"};
+
+        const auto [source, destination] = idx::get_rename_paths(ctx.parameters);
+
+        auto client = std::make_shared<idx::elasticsearch_client>(hosts);
+
+        return idx::handle_rename(
+                     ctx.rei->rsComm
+                   , *client
+                   , idx::get_query_task_configuration(cfg_mgr)
+                   , idx::it::metadata
+                   , source
+                   , destination
+                   , log_verbose
+                   , [&](const std::string& path, bool is_collection, const std::vector<std::string>& index_names) {
+                       idx::prepare_indices(*client, index_cfg, index_names, idx::it::metadata);
+
+                       irods::error last_error = SUCCESS();
+
+                       for(auto&& index_name : index_names) {
+                           irods::error err = SUCCESS();
+
+                           if(is_collection) {
+                               err = backfill_metadata(ctx, cfg_mgr, path, index_name);
+                           }
+                           else {
+                               idx::bulk_request bulk{
+                                   client
+                                 , bulk_count
+                                 , daemon_sock
+                                 , idx::qos_policy{qos_cfg, idx::qos_priority::high}};
+                               err = index_metadata_for_object(
+                                         ctx.rei->rsComm
+                                       , bulk
+                                       , layout
+                                       , *filter
+                                       , path
+                                       , index_name
+                                       , log_verbose);
+                           }
+
+                           if(!err.ok()) {
+                               last_error = err;
+                           }
+                       }
+
+                       return last_error;
+                   });
+
+    } // metadata_rename_elasticsearch
+
+    // compare a collection in the catalog with the metadata indices which
+    // apply to it and repair any differences, or only report them
+    irods::error metadata_reconcile_elasticsearch(const pe::context& ctx)
+    {
+        // clang-format off
+        const auto cfg_mgr     = pe::configuration_manager{ctx.instance_name, ctx.configuration};
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
+        const auto bulk_count  = cfg_mgr.get("bulk_count", uint32_t{100});
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto layout      = idx::get_metadata_layout(cfg_mgr);
+        const auto filter      = idx::get_attribute_filter(cfg_mgr);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg_mgr);
+        const auto index_cfg   = idx::get_index_configuration(cfg_mgr);
+        const auto log_verbose = std::string{"true"} == cfg_mgr.get(std::string{kw::log_errors}, std::string{"false"});
+        // clang-format on
+
+        idx::span root{idx::get_tracing_configuration(cfg_mgr), "metadata_reconcile"};
+        root.set("logical_path", ctx.parameters.at("logical_path").get<std::string>());
+
+        auto client = std::make_shared<idx::elasticsearch_client>(hosts);
+
+        return idx::reconcile_collection(
+                     ctx.rei->rsComm
+                   , *client
+                   , cfg_mgr
+                   , ctx.parameters.at("logical_path").get<std::string>()
+                   , idx::it::metadata
+                   , idx::is_dry_run(ctx.parameters)
+                   , log_verbose
+                   , [&](const std::string& index_name, const std::string& path) {
+                       idx::prepare_indices(*client, index_cfg, index_name, idx::it::metadata);
+
+                       idx::bulk_request bulk{
+                           client
+                         , bulk_count
+                         , daemon_sock
+                         , idx::qos_policy{qos_cfg, idx::qos_priority::low}};
+                       return index_metadata_for_object(
+                                    ctx.rei->rsComm
+                                  , bulk
+                                  , layout
+                                  , *filter
+                                  , path
+                                  , index_name
+                                  , log_verbose);
+                   });
+
+    } // metadata_reconcile_elasticsearch
+
     irods::error metadata_index_elasticsearch(const pe::context& ctx, pe::arg_type out)
     {
+        if(idx::is_reconcile(ctx.parameters)) {
+            return metadata_reconcile_elasticsearch(ctx);
+        }
+
+        if(!idx::event_is_invalid(ctx.parameters, {"RENAME"})) {
+            return metadata_rename_elasticsearch(ctx);
+        }
+
         idx::throw_if_metadata_is_missing(ctx.parameters);
 
         idx::throw_if_conditional_metadata_is_missing(ctx.parameters);
@@ -135,13 +527,20 @@ namespace {
 
         // clang-format off
         const auto cfg_mgr     = pe::configuration_manager{ctx.instance_name, ctx.configuration};
-        const auto hosts       = cfg_mgr.get("hosts", std::vector<std::string>{});
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
+        const auto bulk_count  = cfg_mgr.get("bulk_count", uint32_t{100});
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto layout      = idx::get_metadata_layout(cfg_mgr);
+        const auto filter      = idx::get_attribute_filter(cfg_mgr);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg_mgr);
+        const auto index_cfg   = idx::get_index_configuration(cfg_mgr);
         const auto log_verbose = std::string{"true"} == cfg_mgr.get(std::string{kw::log_errors}, std::string{"false"});
         const auto is_idx_md   = idx::metadata_is_indexing(ctx.parameters.at(kw::metadata));
         const auto index_name  = idx::get_index_name(ctx.parameters);
         // clang-format on
 
-        elasticlient::Client client{hosts};
+        idx::span root{idx::get_tracing_configuration(cfg_mgr), "metadata_index"};
+        root.set("index", index_name);
 
         auto [u, logical_path, sr, dr] =
             capture_parameters(ctx.parameters, tag_first_resc);
@@ -153,24 +552,49 @@ namespace {
             return SUCCESS();
         }
 
+        // an individual avu which is filtered out costs no request at all
+        if((kw::data_object == entity_type || (kw::collection == entity_type && !is_idx_md))
+           && !filter->accepts(attribute, units)) {
+            return SUCCESS();
+        }
+
+        auto client = std::make_shared<idx::elasticsearch_client>(hosts);
+
+        idx::prepare_indices(*client, index_cfg, index_name, idx::it::metadata);
+
+        idx::bulk_request bulk{
+            client
+          , bulk_count
+          , daemon_sock
+          , idx::qos_policy{qos_cfg, idx::qos_priority::high}};
+
         if(kw::data_object == entity_type
            || (kw::collection == entity_type && !is_idx_md)) {
             // adding an individual avu to an object or collection
             return index_metadata(
                          ctx.rei->rsComm
-                       , client
+                       , bulk
+                       , layout
                        , logical_path
                        , index_name
+                       , operation
                        , attribute
                        , value
                        , units
                        , log_verbose);
         }
         else if(kw::collection == entity_type && is_idx_md) {
-            // annotated a collection to be indexed
+            if(idx::is_collection_backfill(ctx.rei->rsComm, ctx.parameters, logical_path)) {
+                // annotated a collection to be indexed, invoked directly
+                return backfill_metadata(ctx, cfg_mgr, logical_path, index_name);
+            }
+
+            // annotated a collection to be indexed, invoked per object
             return index_metadata_for_object(
                          ctx.rei->rsComm
-                       , client
+                       , bulk
+                       , layout
+                       , *filter
                        , logical_path
                        , index_name
                        , log_verbose);
@@ -224,6 +648,9 @@ pe::plugin_pointer_type plugin_factory(
       const std::string& _plugin_name
     , const std::string&) {
 
+    idx::host_selector::instance().set_log_function(
+        [](const std::string& _msg) { rodsLog(LOG_NOTICE, "%s", _msg.c_str()); });
+
     return pe::make(
                  _plugin_name
                , "irods_policy_indexing_metadata_index_elasticsearch"
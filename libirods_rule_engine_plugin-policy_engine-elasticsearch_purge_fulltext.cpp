@@ -3,6 +3,10 @@
 #define IRODS_FILESYSTEM_ENABLE_SERVER_SIDE_API
 
 #include "utilities.hpp"
+#include "indexing_daemon_client.hpp"
+#include "collection_purge.hpp"
+#include "checkpoint.hpp"
+#include "rollover.hpp"
 
 #include "policy_composition_framework_configuration_manager.hpp"
 #include "policy_composition_framework_parameter_capture.hpp"
@@ -25,11 +29,14 @@ namespace {
     namespace fsvr = irods::experimental::filesystem::server;
 
     irods::error purge_fulltext(
-          rsComm_t*                             comm
-        , std::shared_ptr<elasticlient::Client> client
-        , const std::string&                    logical_path
-        , const std::string&                    index_name
-        , const bool                            log_verbose) {
+          rsComm_t*                                  comm
+        , std::shared_ptr<idx::elasticsearch_client> client
+        , const std::string&                         logical_path
+        , const std::string&                         index_name
+        , const std::string&                         daemon_socket
+        , const idx::rollover_configuration&         rollover
+        , const bool                                 route_by_object_id
+        , const bool                                 log_verbose) {
 
         if(log_verbose) {
             rodsLog(
@@ -42,6 +49,36 @@ namespace {
         uint64_t chunk_counter{};
 
         const std::string object_id{idx::get_id_for_logical_path(comm, logical_path)};
+        const std::string routing{idx::get_routing(route_by_object_id, object_id)};
+
+        // the chunks of the object may be spread over the backing indices of
+        // a rollover alias, which can not be deleted from by id
+        if(idx::rollover_aliases::instance().spans_indices(*client, rollover, index_name)) {
+            return idx::run_query_task(
+                         *client
+                       , index_name
+                       , "_delete_by_query"
+                       , idx::json{{"query", {{"term", {{"object_id", std::stoull(object_id)}}}}}}
+                       , fmt::format("purge of [{}] from [{}]", logical_path, index_name)
+                       , idx::query_task_options{false, 0, false, log_verbose, routing});
+        }
+
+        // the daemon deletes the chunks in bulk, the object id is resolved
+        // here as the object will no longer exist in the catalog by then
+        if(!daemon_socket.empty()) {
+            try {
+                idx::daemon_client::instance(daemon_socket).send(
+                    {idx::protocol::operation_type::purge_chunks, {index_name, object_id, routing}});
+                return SUCCESS();
+            }
+            catch(const std::exception& _e) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "indexing daemon unavailable, purging directly for [%s] [%s]"
+                  , logical_path.c_str()
+                  , _e.what());
+            }
+        }
 
         bool done{false};
         while(!done) {
@@ -54,7 +91,7 @@ namespace {
 
             ++chunk_counter;
 
-            const cpr::Response response = client->remove(index_name, "text", index_id);
+            const cpr::Response response = client->remove(index_name, "text", index_id, routing);
             if(response.status_code != 200) {
                 done = true;
             }
@@ -79,22 +116,73 @@ namespace {
         // clang-format off
         const auto cfg_mgr     = pe::configuration_manager{ctx.instance_name, ctx.configuration};
         const auto event       = std::string{ctx.parameters.at(kw::event)};
-        const auto hosts       = cfg_mgr.get("hosts", std::vector<std::string>{});
+        const auto hosts       = idx::get_client_configuration(cfg_mgr);
+        const auto daemon_sock = cfg_mgr.get("daemon_socket", std::string{});
+        const auto rollover    = idx::get_rollover_configuration(cfg_mgr);
+        const auto route_by_id = idx::routing_mode::object_id == idx::get_routing_mode(cfg_mgr);
         const auto log_verbose = std::string{"true"} == cfg_mgr.get(kw::log_errors, std::string{"false"});
         const auto index_name  = idx::get_index_name(ctx.parameters);
         // clang-format on
 
+        idx::span root{idx::get_tracing_configuration(cfg_mgr), "full_text_purge"};
+        root.set("event", event);
+        root.set("index", index_name);
+
         auto [un, logical_path, sr, dr] =
             capture_parameters(ctx.parameters, tag_first_resc);
 
-        std::shared_ptr<elasticlient::Client> client =
-            std::make_shared<elasticlient::Client>(hosts);
+        std::shared_ptr<idx::elasticsearch_client> client =
+            std::make_shared<idx::elasticsearch_client>(hosts);
+
+        if(idx::is_collection_purge(ctx.rei->rsComm, ctx.parameters, logical_path)) {
+            // removed the indexing avu from a collection, invoked directly.
+            // the configuration is read before anything is changed.
+            const auto purge_cfg = idx::get_collection_purge_configuration(cfg_mgr);
+
+            // tagging the collection again backfills it from the start
+            idx::remove_checkpoint(
+                idx::checkpoint{
+                    ctx.rei->rsComm
+                  , idx::get_checkpoint_configuration(cfg_mgr)
+                  , logical_path
+                  , index_name
+                  , idx::it::full_text});
+
+            // its documents are still indexed through a parent collection
+            if(idx::is_covered_by_parent(ctx.rei->rsComm, logical_path, index_name, idx::it::full_text)) {
+                return SUCCESS();
+            }
+
+            if(purge_cfg) {
+                return idx::purge_collection(
+                             ctx.rei->rsComm
+                           , *client
+                           , *purge_cfg
+                           , logical_path
+                           , index_name
+                           , idx::it::full_text
+                           , log_verbose);
+            }
+
+            // without a keyword path field the objects are left to the query
+            // processor, and the collection is purged as any other entity
+            if(log_verbose) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "path_field is not configured, purging [%s] from [%s] by object"
+                  , logical_path.c_str()
+                  , index_name.c_str());
+            }
+        }
 
         return purge_fulltext(
                      ctx.rei->rsComm
                    , client
                    , logical_path
                    , index_name
+                   , daemon_sock
+                   , rollover
+                   , route_by_id
                    , log_verbose);
 
         return SUCCESS();
@@ -144,6 +232,9 @@ pe::plugin_pointer_type plugin_factory(
       const std::string& _plugin_name
     , const std::string&) {
 
+    idx::host_selector::instance().set_log_function(
+        [](const std::string& _msg) { rodsLog(LOG_NOTICE, "%s", _msg.c_str()); });
+
     return pe::make(
                  _plugin_name
                , "irods_policy_indexing_full_text_purge_elasticsearch"
@@ -1,5 +1,11 @@
 
 #include "utilities.hpp"
+#include "attribute_filter.hpp"
+#include "bulk.hpp"
+#include "metadata_layout.hpp"
+#include "collection_purge.hpp"
+#include "checkpoint.hpp"
+#include "rollover.hpp"
 
 #include "policy_composition_framework_configuration_manager.hpp"
 #include "policy_composition_framework_parameter_capture.hpp"
@@ -7,7 +13,6 @@
 
 #include "cpr/response.h"
 #include "elasticlient/client.h"
-#include "elasticlient/bulk.h"
 #include "elasticlient/logging.h"
 
 namespace {
@@ -17,49 +22,89 @@ namespace {
     namespace fs   = irods::experimental::filesystem;
     namespace fsvr = irods::experimental::filesystem::server;
 
+    // add the removal of the avu to the bulk, performing it once bulk_count
+    // actions have been added.  the caller performs whatever remains.
     irods::error purge_metadata(
-          rsComm_t*             comm
-        , elasticlient::Client& client
-        , const std::string&    object_path
-        , const std::string&    index_name
-        , const std::string&    attribute
-        , const std::string&    value
-        , const std::string&    units
-        , const bool            log_verbose) {
+          idx::bulk_request& bulk
+        , const std::string& layout
+        , const std::string& object_id
+        , const std::string& object_path
+        , const std::string& index_name
+        , const std::string& attribute
+        , const std::string& value
+        , const std::string& units
+        , const bool         log_verbose) {
+
+        if(log_verbose) {
+            rodsLog(
+                LOG_NOTICE
+              , "purging metadata [%s] [%s] [%s] in [%s] for path [%s]"
+              , attribute.c_str()
+              , value.c_str()
+              , units.c_str()
+              , index_name.c_str()
+              , object_path.c_str());
+        }
 
-        try {
-            const std::string md_index_id{
-                                  idx::get_metadata_index_id(
-                                      idx::get_id_for_logical_path(
-                                          comm,
-                                          object_path),
-                                      attribute,
-                                      value,
-                                      units)};
-
-            const cpr::Response response = client.remove(index_name, "text", md_index_id);
-
-            if(log_verbose) {
-                rodsLog(
-                    LOG_NOTICE
-                  , "response code [%d] response text [%s]"
-                  , response.status_code
-                  , response.text.c_str());
+        if(idx::metadata_layout::document_per_object == layout) {
+            if(bulk.update_document(
+                       index_name
+                     , object_id
+                     , idx::make_avu_update(
+                           object_id
+                         , object_path
+                         , kw::remove
+                         , attribute
+                         , value
+                         , units))) {
+                return bulk.perform(object_path);
             }
 
-            if(response.status_code != 200 && response.status_code != 201) {
-                return ERROR(
-                    SYS_INTERNAL_ERR,
-                    boost::format("failed to purge metadata [%s] [%s] [%s] for [%s] code [%d] message [%s]")
-                    % attribute
-                    % value
-                    % units
-                    % object_path
-                    % response.status_code
-                    % response.text);
+            return SUCCESS();
+        }
+
+        const std::string md_index_id{
+                              idx::get_metadata_index_id(
+                                  object_id,
+                                  attribute,
+                                  value,
+                                  units)};
+
+        if(bulk.remove_document(index_name, md_index_id)) {
+            return bulk.perform(object_path);
+        }
+
+        return SUCCESS();
+
+    } // purge_metadata
+
+    irods::error purge_metadata(
+          rsComm_t*          comm
+        , idx::bulk_request& bulk
+        , const std::string& layout
+        , const std::string& object_path
+        , const std::string& index_name
+        , const std::string& attribute
+        , const std::string& value
+        , const std::string& units
+        , const bool         log_verbose) {
+
+        try {
+            auto err = purge_metadata(
+                           bulk
+                         , layout
+                         , idx::get_id_for_logical_path(comm, object_path)
+                         , object_path
+                         , index_name
+                         , attribute
+                         , value
+                         , units
+                         , log_verbose);
+            if(!err.ok()) {
+                return err;
             }
 
-            return SUCCESS();
+            return bulk.flush(object_path);
         }
         catch(const irods::exception& e) {
             return ERROR(e.code(), e.what());
@@ -68,18 +113,36 @@ namespace {
     } // purge_metadata
 
     irods::error purge_metadata_for_object(
-          rsComm_t*             comm
-        , elasticlient::Client& client
-        , const std::string&    object_path
-        , const std::string&    index_name
-        , const bool            log_verbose) {
+          rsComm_t*                    comm
+        , idx::bulk_request&           bulk
+        , const std::string&           layout
+        , const idx::attribute_filter& filter
+        , const std::string&           object_path
+        , const std::string&           index_name
+        , const bool                   log_verbose) {
 
         irods::error last_error = SUCCESS();
 
-        for(auto&& avu : fsvr::get_metadata(*comm, object_path)) {
+        std::string object_id{};
+        try {
+            object_id = idx::get_id_for_logical_path(comm, object_path);
+        }
+        catch(const irods::exception& e) {
+            return ERROR(e.code(), e.what());
+        }
+
+        // the whole document of the object goes at once
+        if(idx::metadata_layout::document_per_object == layout) {
+            bulk.remove_document(index_name, object_id);
+            return bulk.flush(object_path);
+        }
+
+        // avus which were filtered out were never indexed
+        for(auto&& avu : filter.select(fsvr::get_metadata(*comm, object_path))) {
             auto err = purge_metadata(
-                             comm
-                           , client
+                             bulk
+                           , layout
+                           , object_id
                            , object_path
                            , index_name
                            , avu.attribute
@@ -91,6 +154,11 @@ namespace {
             }
         } // for avu
 
+        auto err = bulk.flush(object_path);
+        if(!err.ok()) {
+            last_error = err;
+        }
+
         return last_error;
 
     } // purge_metadata_for_object
@@ -109,12 +177,21 @@ namespace {
 
         // clang-format off
         const auto cfg         = pe::configuration_manager{ctx.instance_name, ctx.configuration};
-        const auto hosts       = cfg.get("hosts", std::vector<std::string>{});
+        const auto hosts       = idx::get_client_configuration(cfg);
+        const auto bulk_count  = cfg.get("bulk_count", uint32_t{100});
+        const auto daemon_sock = cfg.get("daemon_socket", std::string{});
+        const auto layout      = idx::get_metadata_layout(cfg);
+        const auto filter      = idx::get_attribute_filter(cfg);
+        const auto qos_cfg     = idx::get_qos_configuration(cfg);
+        const auto rollover    = idx::get_rollover_configuration(cfg);
         const auto verb        = std::string{"true"} == cfg.get(std::string{kw::log_errors}, std::string{"false"});
         const auto is_idx_md   = idx::metadata_is_indexing(ctx.parameters.at(kw::metadata));
         const auto index_name  = idx::get_index_name(ctx.parameters);
         // clang-format on
 
+        idx::span root{idx::get_tracing_configuration(cfg), "metadata_purge"};
+        root.set("index", index_name);
+
         auto [u, logical_path, sr, dr] =
             capture_parameters(ctx.parameters, tag_first_resc);
 
@@ -122,7 +199,64 @@ namespace {
         const auto [attribute, value, units, operation, entity, entity_type] =
             idx::extract_all(ctx.parameters.at(kw::metadata));
 
-        elasticlient::Client client{hosts};
+        // an individual avu which is filtered out was never indexed
+        if((kw::data_object == entity_type || (kw::collection == entity_type && !is_idx_md))
+           && (operation.empty() || kw::remove == operation)
+           && !filter->accepts(attribute, units)) {
+            return SUCCESS();
+        }
+
+        auto client = std::make_shared<idx::elasticsearch_client>(hosts);
+
+        if(idx::is_collection_purge(ctx.rei->rsComm, ctx.parameters, logical_path)) {
+            // removed the indexing avu from a collection, invoked directly.
+            // the configuration is read before anything is changed.
+            const auto purge_cfg = idx::get_collection_purge_configuration(cfg);
+
+            // tagging the collection again backfills it from the start
+            idx::remove_checkpoint(
+                idx::checkpoint{
+                    ctx.rei->rsComm
+                  , idx::get_checkpoint_configuration(cfg)
+                  , logical_path
+                  , index_name
+                  , idx::it::metadata});
+
+            // its documents are still indexed through a parent collection
+            if(idx::is_covered_by_parent(ctx.rei->rsComm, logical_path, index_name, idx::it::metadata)) {
+                return SUCCESS();
+            }
+
+            if(purge_cfg) {
+                return idx::purge_collection(
+                             ctx.rei->rsComm
+                           , *client
+                           , *purge_cfg
+                           , logical_path
+                           , index_name
+                           , idx::it::metadata
+                           , verb);
+            }
+
+            // without a keyword path field the objects are left to the query
+            // processor, and the collection is purged as any other entity
+            if(verb) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "path_field is not configured, purging [%s] from [%s] by object"
+                  , logical_path.c_str()
+                  , index_name.c_str());
+            }
+        }
+
+        // the bulk deletes from the backing index holding each document
+        idx::rollover_aliases::instance().spans_indices(*client, rollover, index_name);
+
+        idx::bulk_request bulk{
+            client
+          , bulk_count
+          , daemon_sock
+          , idx::qos_policy{qos_cfg, idx::qos_priority::high}};
 
         if(kw::data_object == entity_type
            || (kw::collection == entity_type && !is_idx_md)) {
@@ -133,7 +267,8 @@ namespace {
 
             return purge_metadata(
                          ctx.rei->rsComm
-                       , client
+                       , bulk
+                       , layout
                        , logical_path
                        , index_name
                        , attribute
@@ -144,7 +279,9 @@ namespace {
         else if(kw::collection == entity_type) {
             return purge_metadata_for_object(
                          ctx.rei->rsComm
-                       , client
+                       , bulk
+                       , layout
+                       , *filter
                        , logical_path
                        , index_name
                        , verb);
@@ -204,6 +341,9 @@ pe::plugin_pointer_type plugin_factory(
       const std::string& _plugin_name
     , const std::string&) {
 
+    idx::host_selector::instance().set_log_function(
+        [](const std::string& _msg) { rodsLog(LOG_NOTICE, "%s", _msg.c_str()); });
+
     return pe::make(
                  _plugin_name
                , "irods_policy_indexing_metadata_purge_elasticsearch"
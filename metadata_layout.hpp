@@ -0,0 +1,126 @@
+#ifndef IRODS_INDEXING_METADATA_LAYOUT_HPP
+#define IRODS_INDEXING_METADATA_LAYOUT_HPP
+
+#include "utilities.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+#include "policy_composition_framework_keywords.hpp"
+
+namespace irods::indexing {
+
+    namespace metadata_layout {
+        // one document per avu, identified by a digest of the object id and avu
+        const std::string document_per_avu{"document_per_avu"};
+        // one document per object, identified by the object id, holding all
+        // of its avus in a nested avus array
+        const std::string document_per_object{"document_per_object"};
+    }
+
+    auto get_metadata_layout(const pe::configuration_manager& _cfg)
+    {
+        auto l = _cfg.get("metadata_layout", metadata_layout::document_per_avu);
+
+        if(metadata_layout::document_per_avu != l
+           && metadata_layout::document_per_object != l) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid metadata_layout [{}]", l));
+        }
+
+        return l;
+
+    } // get_metadata_layout
+
+    auto make_avu(
+          const std::string& _attribute
+        , const std::string& _value
+        , const std::string& _units)
+    {
+        return json{
+            {"attribute", _attribute},
+            {"value",     _value},
+            {"units",     _units}};
+
+    } // make_avu
+
+    // the complete document for an object, replacing whatever was indexed
+    auto make_object_document(
+          const std::string&               _object_id
+        , const std::string&               _logical_path
+        , const std::vector<fs::metadata>& _avus)
+    {
+        auto avus = json::array();
+        for(auto&& avu : _avus) {
+            avus.push_back(make_avu(avu.attribute, avu.value, avu.units));
+        }
+
+        return json{
+            {"logical_path", _logical_path},
+            {"object_id",    std::stoull(_object_id)},
+            {"avus",         avus}}.dump();
+
+    } // make_object_document
+
+    // a scripted partial update applying a single avu operation to the
+    // document of an object.  add and set create the document should it not
+    // yet exist, set replaces every avu with the same attribute as irods
+    // does.  a remove of an object with no document is a no op, and the
+    // remove of its last avu deletes the document.
+    auto make_avu_update(
+          const std::string& _object_id
+        , const std::string& _logical_path
+        , const std::string& _operation
+        , const std::string& _attribute
+        , const std::string& _value
+        , const std::string& _units)
+    {
+        // clang-format off
+        static const std::string initialize{
+            "if (ctx._source.avus == null) { ctx._source.avus = []; } "
+            "ctx._source.logical_path = params.logical_path; "
+            "ctx._source.object_id = params.object_id; "};
+
+        static const std::string add{initialize +
+            "if (!ctx._source.avus.contains(params.avu)) { ctx._source.avus.add(params.avu); }"};
+
+        static const std::string set{initialize +
+            "ctx._source.avus.removeIf(a -> a.attribute == params.avu.attribute); "
+            "ctx._source.avus.add(params.avu);"};
+
+        static const std::string remove{
+            "if (ctx._source.avus == null || !ctx._source.avus.removeIf(a -> "
+            "a.attribute == params.avu.attribute && "
+            "a.value == params.avu.value && "
+            "a.units == params.avu.units)) { ctx.op = 'none'; } "
+            "else if (ctx._source.avus.isEmpty()) { ctx.op = 'delete'; }"};
+        // clang-format on
+
+        json script{
+            {"lang",   "painless"},
+            {"params", {
+                {"logical_path", _logical_path},
+                {"object_id",    std::stoull(_object_id)},
+                {"avu",          make_avu(_attribute, _value, _units)}}}};
+
+        namespace pkw = irods::policy_composition::keywords;
+
+        json update{};
+
+        if(pkw::remove == _operation) {
+            script["source"] = remove;
+        }
+        else {
+            script["source"] = pkw::set == _operation ? set : add;
+            update["scripted_upsert"] = true;
+            update["upsert"] = json::object();
+        }
+
+        update["script"] = script;
+
+        return update.dump();
+
+    } // make_avu_update
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_METADATA_LAYOUT_HPP
@@ -5,9 +5,11 @@ import contextlib
 import tempfile
 import json
 import os.path
+import subprocess
 import pycurl
 
 from time import sleep
+import time
 
 if sys.version_info >= (2, 7):
     import unittest
@@ -52,6 +54,17 @@ def index_event_handler_configured(arg=None):
                                     "bulk_count" : 100,
                                     "read_size" : 1024
                             }
+                        },
+                        {
+                            "active_policy_clauses" : ["post"],
+                            "events" : ["rename"],
+                            "policy_to_invoke" : "irods_policy_indexing_full_text_index_elasticsearch",
+                            "configuration" : {
+                                    "hosts" : ["http://localhost:9200/"],
+                                    "path_field" : "logical_path.keyword",
+                                    "bulk_count" : 100,
+                                    "read_size" : 1024
+                            }
                         }
                     ]
                 }
@@ -93,6 +106,15 @@ def index_event_handler_configured(arg=None):
             }
         )
 
+        # additional configuration for every policy
+        if arg is not None:
+            for event_handler in irods_config.server_config['plugin_configuration']['rule_engines']:
+                for p in event_handler.get('plugin_specific_configuration', {}).get('policies_to_invoke', []):
+                    if 'parameters' in p:
+                        p['parameters']['configuration'].update(arg)
+                    else:
+                        p['configuration'].update(arg)
+
         irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
            {
                 "instance_name": "irods_rule_engine_plugin-policy_engine-query_processor-instance",
@@ -104,6 +126,64 @@ def index_event_handler_configured(arg=None):
         )
 
 
+        irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
+           {
+                "instance_name": "irods_rule_engine_plugin-policy_engine-elasticsearch_index_fulltext-instance",
+                "plugin_name": "irods_rule_engine_plugin-policy_engine-elasticsearch_index_fulltext",
+                "plugin_specific_configuration": {
+                    "log_errors" : "true"
+                }
+           }
+        )
+
+        irods_config.commit(irods_config.server_config, irods_config.server_config_path)
+
+        IrodsController().restart()
+
+        try:
+            yield
+        finally:
+            pass
+
+@contextlib.contextmanager
+def backfill_event_handler_configured(arg=None):
+    filename = paths.server_config_path()
+    with lib.file_backed_up(filename):
+        irods_config = IrodsConfig()
+
+        irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
+            {
+                "instance_name": "irods_rule_engine_plugin-event_handler-metadata_modified-instance",
+                "plugin_name": "irods_rule_engine_plugin-event_handler-metadata_modified",
+                'plugin_specific_configuration': {
+                    "policies_to_invoke" : [
+                         {
+                             "active_policy_clauses" : ["post"],
+                             "events" : ["metadata"],
+                             "conditional" : {
+                                 "metadata_applied" : {
+                                     "attribute"   : "irods::indexing::index",
+                                     "entity_type" : "collection",
+                                     "operation"   : ["set", "add"]
+                                 }
+                             },
+                             "policy_to_invoke" : "irods_policy_indexing_full_text_index_elasticsearch",
+                             "parameters" : {
+                                 "mode" : "backfill"
+                             },
+                             "configuration" : {
+                                 "hosts" : ["http://localhost:9200/"],
+                                 "bulk_count" : 100,
+                                 "read_size" : 1024,
+                                 "backfill_threads" : 2,
+                                 "backfill_batch_size" : 2
+                             }
+                         }
+                     ]
+                }
+            }
+        )
+
         irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
            {
                 "instance_name": "irods_rule_engine_plugin-policy_engine-elasticsearch_index_fulltext-instance",
@@ -169,6 +249,55 @@ def assert_index_content(expected_output):
             #print(out)
             done = True
 
+def assert_index_content_absent(unexpected_output):
+    max_iter = 10
+    counter = 0
+    while True:
+        out, _ = lib.execute_command(curl_get_wildcard)
+        if -1 == out.find(unexpected_output):
+            return
+        counter = counter + 1
+        if(counter > max_iter):
+            assert(False)
+        sleep(1)
+
+daemon_socket = '/tmp/irods_indexing_daemon_test.sock'
+daemon_metrics = '/tmp/irods_indexing_daemon_test_metrics.json'
+
+@contextlib.contextmanager
+def indexing_daemon_running():
+    config_file = '/tmp/irods_indexing_daemon_test.json'
+    with open(config_file, 'w') as f:
+        json.dump({"socket_path" : daemon_socket,
+                   "hosts" : ["http://localhost:9200/"],
+                   "flush_interval_ms" : 100,
+                   "metrics_interval_ms" : 0,
+                   "metrics_path" : daemon_metrics}, f)
+
+    if os.path.exists(daemon_metrics):
+        os.remove(daemon_metrics)
+
+    daemon = subprocess.Popen(['/usr/sbin/irods_indexing_daemon', '--config', config_file])
+    try:
+        counter = 0
+        while not os.path.exists(daemon_socket):
+            counter = counter + 1
+            if(counter > 10):
+                assert(False)
+            sleep(1)
+
+        yield daemon
+
+    finally:
+        # the pending actions are flushed and the metrics written on exit
+        daemon.terminate()
+        daemon.wait()
+        os.remove(config_file)
+
+def daemon_metrics_sent():
+    with open(daemon_metrics) as f:
+        return json.load(f)['sent']
+
 class TestElasticSearchIndexingFullText(ResourceBase, unittest.TestCase):
     def repave_index(self):
         output, _ = lib.execute_command(curl_delete)
@@ -199,6 +328,232 @@ class TestElasticSearchIndexingFullText(ResourceBase, unittest.TestCase):
                 admin_session.assert_icommand('irm -f ' + logical_path)
                 admin_session.assert_icommand('iadmin rum')
 
+    def test_indexing_put_file_with_bandwidth_limits(self):
+        self.repave_index()
+        control_file = '/tmp/indexing_qos.json'
+        with open(control_file, 'w') as f:
+            json.dump({"read_bytes_per_second" : 65536}, f)
+
+        trace_file = '/tmp/indexing_traces.json'
+        if os.path.exists(trace_file):
+            os.remove(trace_file)
+
+        # four seconds of reading at the limit, beyond a burst of a tenth of one
+        physical_path = os.path.join(tempfile.mkdtemp(), 'bandwidth_limited_file.txt')
+        with open(physical_path, 'w') as f:
+            f.write('bandwidth limited ' * (262144 // 18))
+
+        with session.make_session_for_existing_admin() as admin_session:
+            logical_path  = '/tempZone/home/rods/bandwidth_limited_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                # the control file takes the place of the configured read limit
+                limits = {"qos_read_bytes_per_second" : 1, "qos_send_bytes_per_second" : 65536, "qos_burst_ms" : 100,
+                          "qos_control_file" : control_file, "trace_file" : trace_file, "trace_sample_rate" : 1.0}
+                with index_event_handler_configured(limits):
+                    start = time.time()
+                    admin_session.assert_icommand('iput -f ' + physical_path)
+                    elapsed = time.time() - start
+
+                assert_index_content('"logical_path" : "'+logical_path+'"')
+
+                # the reads were held to the limit rather than the configured
+                # one byte per second, which would never complete
+                assert(elapsed >= 3)
+
+                throttle_ms = 0
+                with open(trace_file) as f:
+                    for line in f:
+                        for rs in json.loads(line)['resourceSpans']:
+                            for ss in rs['scopeSpans']:
+                                for sp in ss['spans']:
+                                    if sp['name'] in ['read_object', 'compute_checksum']:
+                                        for a in sp['attributes']:
+                                            if 'throttle_ms' == a['key']:
+                                                throttle_ms += int(a['value']['intValue'])
+
+                assert(throttle_ms >= 3000)
+
+            finally:
+                os.remove(control_file)
+                if os.path.exists(trace_file):
+                    os.remove(trace_file)
+                shutil.rmtree(os.path.dirname(physical_path))
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_put_file_through_daemon(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_index_test_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                with indexing_daemon_running():
+                    with index_event_handler_configured({"daemon_socket" : daemon_socket}):
+                        admin_session.assert_icommand('iput -f ' + physical_path)
+                        assert_index_content('"logical_path" : "'+logical_path+'"')
+
+                # the chunks were sent by the daemon rather than by the agent
+                assert(daemon_metrics_sent() > 0)
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_put_file_with_daemon_down(self):
+        self.repave_index()
+        if os.path.exists(daemon_socket):
+            os.remove(daemon_socket)
+
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_index_test_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                # nothing listens on the socket, the bulks are sent directly
+                with index_event_handler_configured({"daemon_socket" : daemon_socket}):
+                    admin_session.assert_icommand('iput -f ' + physical_path)
+
+                assert_index_content('"logical_path" : "'+logical_path+'"')
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_put_file_with_tracing(self):
+        self.repave_index()
+        trace_file = '/tmp/indexing_traces.json'
+        if os.path.exists(trace_file):
+            os.remove(trace_file)
+
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_index_test_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                with index_event_handler_configured({"trace_file" : trace_file, "trace_sample_rate" : 1.0}):
+                    admin_session.assert_icommand('iput -f ' + physical_path)
+
+                assert_index_content('"logical_path" : "'+logical_path+'"')
+
+                # each invocation is written as one line of otlp json
+                names = []
+                with open(trace_file) as f:
+                    for line in f:
+                        for rs in json.loads(line)['resourceSpans']:
+                            for ss in rs['scopeSpans']:
+                                names += [s['name'] for s in ss['spans']]
+
+                assert('full_text_index' in names)
+                assert('read_object' in names)
+                assert('bulk_request' in names)
+
+            finally:
+                if os.path.exists(trace_file):
+                    os.remove(trace_file)
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_put_file_with_managed_templates(self):
+        # the index is left to be created from the template on first write
+        lib.execute_command(curl_delete)
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_index_test_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                with index_event_handler_configured({"index_templates" : "managed", "template_source" : "compressed"}):
+                    admin_session.assert_icommand('iput -f ' + physical_path)
+
+                assert_index_content('"logical_path" : "'+logical_path+'"')
+
+                out, _ = lib.execute_command('curl -s http://localhost:9200/full_text_index/_mapping')
+                mapping = json.loads(out)['full_text_index']['mappings']['text']['properties']
+                assert(mapping['logical_path']['type'] == 'keyword')
+                assert(mapping['data']['analyzer'] == 'irods_full_text')
+
+                out, _ = lib.execute_command('curl -s http://localhost:9200/_template/irods_indexing_full_text_index')
+                assert(json.loads(out)['irods_indexing_full_text_index']['version'] >= 1)
+
+            finally:
+                lib.execute_command('curl -X DELETE http://localhost:9200/_template/irods_indexing_full_text_index')
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_put_file_with_rollover(self):
+        # the name is left to become a write alias on first write
+        lib.execute_command(curl_delete)
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path0 = '/tempZone/home/rods/rollover_file0'
+            logical_path1 = '/tempZone/home/rods/rollover_file1'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                with index_event_handler_configured({"rollover" : "true", "rollover_max_docs" : 1, "rollover_check_interval_ms" : 0}):
+                    admin_session.assert_icommand('iput -f ' + physical_path + ' ' + logical_path0)
+                    lib.execute_command('curl -X POST http://localhost:9200/full_text_index/_refresh')
+                    admin_session.assert_icommand('iput -f ' + physical_path + ' ' + logical_path1)
+                    # written again, the first object stays in its backing index
+                    admin_session.assert_icommand('iput -f ' + physical_path + ' ' + logical_path0)
+
+                assert_index_content('"logical_path" : "'+logical_path0+'"')
+                assert_index_content('"logical_path" : "'+logical_path1+'"')
+
+                out, _ = lib.execute_command('curl -s http://localhost:9200/_alias/full_text_index')
+                indices = json.loads(out)
+                assert('full_text_index-000001' in indices)
+                assert(len(indices) > 1)
+
+                lib.execute_command('curl -X POST http://localhost:9200/full_text_index/_refresh')
+                out, _ = lib.execute_command('curl -s "http://localhost:9200/full_text_index/_count?q=chunk:0"')
+                assert(json.loads(out)['count'] == 2)
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path0)
+                admin_session.assert_icommand('irm -f ' + logical_path1)
+                admin_session.assert_icommand('iadmin rum')
+                lib.execute_command('curl -X DELETE http://localhost:9200/full_text_index-0*')
+                self.repave_index()
+
+    def test_indexing_put_file_records_checksum_after_chunks(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_index_test_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                # many chunks spanning more than one bulk
+                with index_event_handler_configured():
+                    admin_session.assert_icommand('iput -fK ' + physical_path)
+
+                assert_index_content('"logical_path" : "'+logical_path+'"')
+
+                # recorded by an update of the first chunk alone
+                lib.execute_command('curl -X POST http://localhost:9200/full_text_index/_refresh')
+                out, _ = lib.execute_command('curl -s "http://localhost:9200/full_text_index/_count?q=_exists_:checksum"')
+                assert(json.loads(out)['count'] == 1)
+                out, _ = lib.execute_command('curl -s "http://localhost:9200/full_text_index/_count?q=chunk:0%20AND%20_exists_:checksum"')
+                assert(json.loads(out)['count'] == 1)
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + logical_path)
+                admin_session.assert_icommand('iadmin rum')
+
     def test_indexing_full_collection(self):
         self.repave_index()
         with session.make_session_for_existing_admin() as admin_session:
@@ -225,5 +580,50 @@ class TestElasticSearchIndexingFullText(ResourceBase, unittest.TestCase):
                 admin_session.assert_icommand('irm -rf index_dir')
                 admin_session.assert_icommand('iadmin rum')
 
+    def test_indexing_full_collection_backfill(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path0 = '/tempZone/home/rods/index_dir/file0'
+            logical_path1 = '/tempZone/home/rods/index_dir/sub_dir/file1'
+            logical_path2 = '/tempZone/home/rods/index_dir/sub_dir/file2'
+            try:
+                admin_session.assert_icommand('imkdir -p index_dir/sub_dir')
+                admin_session.assert_icommand('iput -f ' + physical_path + ' index_dir/file0')
+                admin_session.assert_icommand('iput -f ' + physical_path + ' index_dir/sub_dir/file1')
+                admin_session.assert_icommand('iput -f ' + physical_path + ' index_dir/sub_dir/file2')
+
+                with backfill_event_handler_configured():
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/index_dir irods::indexing::index full_text_index::full_text elasticsearch')
+
+                assert_index_content('"logical_path" : "'+logical_path0+'"')
+                assert_index_content('"logical_path" : "'+logical_path1+'"')
+                assert_index_content('"logical_path" : "'+logical_path2+'"')
 
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home/rods/index_dir irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -rf index_dir')
+                admin_session.assert_icommand('iadmin rum')
 
+    def test_indexing_rename_file(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_index_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_index_test_file.txt'
+            renamed_path  = '/tempZone/home/rods/full_text_index_renamed_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                with index_event_handler_configured():
+                    admin_session.assert_icommand('iput -f ' + physical_path)
+                    assert_index_content('"logical_path" : "'+logical_path+'"')
+
+                    admin_session.assert_icommand('imv ' + logical_path + ' ' + renamed_path)
+
+                assert_index_content('"logical_path" : "'+renamed_path+'"')
+                assert_index_content_absent('"logical_path" : "'+logical_path+'"')
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('irm -f ' + renamed_path)
+                admin_session.assert_icommand('iadmin rum')
@@ -25,7 +25,7 @@ from .. import lib
 import ustrings
 
 @contextlib.contextmanager
-def metadata_event_handler_configured(arg=None):
+def metadata_event_handler_configured(arg=None, backfill=False):
     filename = paths.server_config_path()
     with lib.file_backed_up(filename):
         irods_config = IrodsConfig()
@@ -101,6 +101,40 @@ def metadata_event_handler_configured(arg=None):
             }
         )
 
+        # a tagged collection is backfilled directly rather than through the
+        # query processor
+        if backfill:
+            event_handler = irods_config.server_config['plugin_configuration']['rule_engines'][0]
+            policies = event_handler['plugin_specific_configuration']['policies_to_invoke']
+            policies[-1] = {
+                "active_policy_clauses" : ["post"],
+                "events" : ["metadata"],
+                "conditional" : {
+                    "metadata_applied" : {
+                        "attribute" : "irods::indexing::index",
+                        "entity_type" : "collection",
+                        "operation" : ["set", "add"]
+                    }
+                },
+                "policy_to_invoke" : "irods_policy_indexing_metadata_index_elasticsearch",
+                "parameters" : {
+                    "mode" : "backfill"
+                },
+                "configuration" : {
+                    "hosts" : ["http://localhost:9200/"],
+                    "bulk_count" : 100
+                }
+            }
+
+        # additional configuration for every policy
+        if arg is not None:
+            event_handler = irods_config.server_config['plugin_configuration']['rule_engines'][0]
+            for p in event_handler['plugin_specific_configuration']['policies_to_invoke']:
+                if 'configuration' in p.get('parameters', {}):
+                    p['parameters']['configuration'].update(arg)
+                else:
+                    p['configuration'].update(arg)
+
         irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
            {
                 "instance_name": "irods_rule_engine_plugin-policy_engine-query_processor-instance",
@@ -171,6 +205,36 @@ curl_schema = """
 curl -X PUT -H'Content-Type: application/json' http://localhost:9200/metadata_index/_mapping/text -d '{ "properties" : { "logical_path" : { "type" : "text" }, "attribute" : { "type" : "text" }, "value" : { "type" : "text" }, "unit" : { "type" : "text" } } }'
 """
 
+curl_schema_per_object = """
+curl -X PUT -H'Content-Type: application/json' http://localhost:9200/metadata_index/_mapping/text -d '{ "properties" : { "logical_path" : { "type" : "keyword" }, "object_id" : { "type" : "long" }, "avus" : { "type" : "nested", "properties" : { "attribute" : { "type" : "keyword" }, "value" : { "type" : "keyword" }, "units" : { "type" : "keyword" } } } } }'
+"""
+
+curl_get_per_object = """
+curl -X GET -H'Content-Type: application/json' HTTP://localhost:9200/metadata_index/text/_search?pretty=true -d '
+{
+    "from": 0, "size" : 500,
+    "query" : {
+        "bool" : {
+            "must" : [
+                { "nested" : { "path" : "avus", "query" : { "bool" : { "must" : [ { "term" : { "avus.attribute" : "a0" } }, { "term" : { "avus.value" : "v0" } } ] } } } },
+                { "nested" : { "path" : "avus", "query" : { "bool" : { "must" : [ { "term" : { "avus.attribute" : "a1" } }, { "term" : { "avus.value" : "v1" } } ] } } } }
+            ]
+        }
+    }
+}'
+"""
+
+reconcile_rule = """
+irods_policy_indexing_metadata_index_elasticsearch(
+    '{{"logical_path" : "{0}", "mode" : "reconcile", "dry_run" : "{1}"}}',
+    '{{"hosts" : ["http://localhost:9200/"], "path_field" : "logical_path.keyword", "log_errors" : "true"}}',
+    *out)
+"""
+
+def reconcile_collection(session, logical_path, dry_run):
+    rule = reconcile_rule.format(logical_path, 'true' if dry_run else 'false')
+    session.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-irods_rule_language-instance', rule, 'null', 'ruleExecOut'])
+
 def assert_index_content(expected_output):
     max_iter = 10
     counter = 0
@@ -266,5 +330,272 @@ class TestElasticSearchIndexingMetadata(ResourceBase, unittest.TestCase):
                 admin_session.assert_icommand('irm -rf ' + dir1)
                 admin_session.assert_icommand('iadmin rum')
 
+    def test_indexing_tagged_collection_through_query_processor(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_indexing_tagged_collection_through_query_processor'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -C ' + dir1 + ' c0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/1' + ' a1 v1 u1')
+
+                initial_log_size = lib.get_file_size_by_path(paths.server_log_path())
+                with metadata_event_handler_configured():
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+
+                # the collection itself, and each object once by the query processor
+                assert_index_content('"attribute" : "c0"')
+                assert_index_content('"attribute" : "a0"')
+                assert_index_content('"attribute" : "a1"')
+                assert(0 == lib.count_occurrences_of_string_in_log(paths.server_log_path(), 'backfill started', start_index=initial_log_size))
 
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
 
+    def test_indexing_full_collection_with_bulk_load(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_indexing_full_collection_with_bulk_load'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/1' + ' a1 v1 u1')
+                with metadata_event_handler_configured({"backfill_bulk_load" : "true", "backfill_drop_replicas" : "true"}, backfill=True):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                assert_index_content('"attribute" : "a0"')
+                assert_index_content('"attribute" : "a1"')
+
+                # the original settings are back and nothing holds the index
+                out, _ = lib.execute_command('curl -s http://localhost:9200/metadata_index/_settings?flat_settings=true')
+                settings = json.loads(out)['metadata_index']['settings']
+                assert(settings.get('index.refresh_interval') != '-1')
+                assert(settings['index.number_of_replicas'] == '1')
+
+                out, _ = lib.execute_command('curl -s http://localhost:9200/irods_indexing_bulk_load/text/metadata_index')
+                assert(not json.loads(out).get('found', False))
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_full_collection_with_set_based_avus(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_indexing_full_collection_with_set_based_avus'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,3)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a1 v1 u1')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/2' + ' a2 v2 u2')
+                with metadata_event_handler_configured({"backfill_avus" : "set", "backfill_batch_size" : 1}, backfill=True):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                assert_index_content('"attribute" : "a0"')
+                assert_index_content('"attribute" : "a1"')
+                assert_index_content('"attribute" : "a2"')
+
+                lib.execute_command('curl -X POST http://localhost:9200/metadata_index/_refresh')
+                out, _ = lib.execute_command('curl -s http://localhost:9200/metadata_index/_count')
+                assert(json.loads(out)['count'] == 3)
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_full_collection_with_attribute_filter(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_indexing_full_collection_with_attribute_filter'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' b0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/1' + ' a1 v1 tmp_u1')
+                with metadata_event_handler_configured({"include_attributes" : [{"glob" : "a*"}], "exclude_units" : ["tmp_u1"]}, backfill=True):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    admin_session.assert_icommand('imeta add -d ' + dir1+'/1' + ' b1 v1 u1')
+                assert_index_content('"attribute" : "a0"')
+
+                lib.execute_command('curl -X POST http://localhost:9200/metadata_index/_refresh')
+                for attribute in ['b0', 'a1', 'b1', 'irods::indexing::index']:
+                    out, _ = lib.execute_command('curl -s -H\'Content-Type: application/json\' http://localhost:9200/metadata_index/_count -d \'{"query" : {"match" : {"attribute" : "' + attribute + '"}}}\'')
+                    assert(json.loads(out)['count'] == 0)
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_full_collection_resumes_from_checkpoint(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_indexing_full_collection_resumes_from_checkpoint'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/1' + ' a1 v1 u1')
+
+                # an interrupted run which saved its cursor after the first object
+                out, _, _ = admin_session.run_icommand(['iquest', '%s', "SELECT DATA_ID WHERE COLL_NAME = '/tempZone/home/rods/dir1' AND DATA_NAME = '0'"])
+                admin_session.assert_icommand('imeta add -C ' + dir1 + ' irods::indexing::checkpoint metadata_index::metadata ' + out.strip())
+
+                initial_log_size = lib.get_file_size_by_path(paths.server_log_path())
+                with metadata_event_handler_configured({"checkpoint_store" : "avu"}, backfill=True):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content('"attribute" : "a1"')
+
+                # the object at the cursor is not processed again
+                lib.execute_command('curl -X POST http://localhost:9200/metadata_index/_refresh')
+                out, _ = lib.execute_command('curl -s -H\'Content-Type: application/json\' http://localhost:9200/metadata_index/_count -d \'{"query" : {"match" : {"attribute" : "a0"}}}\'')
+                assert(json.loads(out)['count'] == 0)
+                assert(1 == lib.count_occurrences_of_string_in_log(paths.server_log_path(), 'backfill resuming', start_index=initial_log_size))
+
+                # the completed run removes its checkpoint
+                admin_session.assert_icommand_fail('imeta ls -C ' + dir1, 'STDOUT_SINGLELINE', 'irods::indexing::checkpoint')
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_document_per_object(self):
+        lib.execute_command(curl_delete)
+        lib.execute_command(curl_create)
+        lib.execute_command(curl_schema_per_object)
+        with session.make_session_for_existing_admin() as admin_session:
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index metadata_index::metadata elasticsearch')
+            filename = 'test_put_file'
+            lib.create_local_testfile(filename)
+            admin_session.assert_icommand('iput ' + filename)
+
+            try:
+                with metadata_event_handler_configured({"metadata_layout" : "document_per_object"}):
+                    admin_session.assert_icommand('imeta add -d ' + filename + ' a0 v0 u0')
+                    admin_session.assert_icommand('imeta add -d ' + filename + ' a1 v1 u1')
+
+                    # a single document matching both avus
+                    sleep(2)
+                    out, _ = lib.execute_command(curl_get_per_object)
+                    assert(1 == out.count('"_id"'))
+                    assert(-1 != out.find(filename))
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index metadata_index::metadata elasticsearch')
+                admin_session.assert_icommand('irm -f ' + filename)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_document_per_object_without_avus(self):
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_indexing_document_per_object_without_avus'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+
+                # the avus fetched per object and with the objects, neither
+                # writes a document for the object without avus
+                for backfill_avus in ['per_object', 'set']:
+                    lib.execute_command(curl_delete)
+                    lib.execute_command(curl_create)
+                    lib.execute_command(curl_schema_per_object)
+
+                    config = {"metadata_layout" : "document_per_object", "backfill_avus" : backfill_avus}
+                    with metadata_event_handler_configured(config, backfill=True):
+                        admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                        assert_index_content('"attribute" : "a0"')
+
+                    lib.execute_command('curl -X POST http://localhost:9200/metadata_index/_refresh')
+                    out, _ = lib.execute_command('curl -s http://localhost:9200/metadata_index/_count')
+                    assert(json.loads(out)['count'] == 1)
+
+                    admin_session.assert_icommand('imeta rm -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_reconcile_collection(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_reconcile_collection'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+
+                # applied while no policy is configured, so nothing is indexed
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/1' + ' a1 v1 u1')
+                admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+
+                with metadata_event_handler_configured():
+                    # a dry run only reports the missing objects
+                    reconcile_collection(admin_session, '/tempZone/home/rods/dir1', True)
+                    sleep(2)
+                    out, _ = lib.execute_command(curl_get_wildcard)
+                    assert(-1 == out.find('"attribute" : "a0"'))
+
+                    reconcile_collection(admin_session, '/tempZone/home/rods/dir1', False)
+
+                assert_index_content('"attribute" : "a0"')
+                assert_index_content('"value" : "v0"')
+                assert_index_content('"attribute" : "a1"')
+                assert_index_content('"value" : "v1"')
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_indexing_with_unavailable_host(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index metadata_index::metadata elasticsearch')
+            filename = 'test_put_file'
+            lib.create_local_testfile(filename)
+            admin_session.assert_icommand('iput ' + filename)
+
+            try:
+                # nothing listens on the first host, requests fail over to the second
+                hosts = {"hosts" : ["http://localhost:9201/", "http://localhost:9200/"], "request_timeout_ms" : 1000}
+                with metadata_event_handler_configured(hosts):
+                    admin_session.assert_icommand('imeta set -d ' + filename + ' a0 v0 u0')
+                    admin_session.assert_icommand('imeta set -d ' + filename + ' a1 v1 u1')
+
+                assert_index_content('"attribute" : "a0"')
+                assert_index_content('"attribute" : "a1"')
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index metadata_index::metadata elasticsearch')
+                admin_session.assert_icommand('irm -f ' + filename)
+                admin_session.assert_icommand('iadmin rum')
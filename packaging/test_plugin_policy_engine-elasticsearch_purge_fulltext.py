@@ -138,6 +138,15 @@ def purge_event_handler_configured(arg=None):
             }
         )
 
+        # additional configuration for every policy
+        if arg is not None:
+            for event_handler in irods_config.server_config['plugin_configuration']['rule_engines'][0:2]:
+                for p in event_handler['plugin_specific_configuration']['policies_to_invoke']:
+                    if 'parameters' in p:
+                        p['parameters']['configuration'].update(arg)
+                    else:
+                        p['configuration'].update(arg)
+
         irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
            {
                 "instance_name": "irods_rule_engine_plugin-policy_engine-query_processor-instance",
@@ -256,6 +265,26 @@ class TestElasticSearchPurgeFullText(ResourceBase, unittest.TestCase):
                 admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
                 admin_session.assert_icommand('iadmin rum')
 
+    def test_purge_rm_file_with_routing(self):
+        self.repave_index()
+        with session.make_session_for_existing_admin() as admin_session:
+            physical_path = '/var/lib/irods/scripts/irods/test/full_text_purge_test_file.txt'
+            logical_path  = '/tempZone/home/rods/full_text_purge_test_file.txt'
+            admin_session.assert_icommand('imeta set -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+
+            try:
+                with purge_event_handler_configured({"routing" : "object_id"}):
+                    admin_session.assert_icommand('iput -f ' + physical_path)
+                    assert_index_content('"logical_path" : "'+logical_path+'"')
+                    assert_index_content('"_routing" : "')
+
+                    admin_session.assert_icommand('irm -f ' + logical_path)
+                    assert_index_content('"hits" : [ ]')
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home irods::indexing::index full_text_index::full_text elasticsearch')
+                admin_session.assert_icommand('iadmin rum')
+
     def test_purge_full_collection(self):
         self.repave_index()
         with session.make_session_for_existing_admin() as admin_session:
@@ -166,6 +166,11 @@ def metadata_event_handler_configured(arg=None):
             }
         )
 
+        # replace the query processor purge with the given policy
+        if arg is not None:
+            event_handler = irods_config.server_config['plugin_configuration']['rule_engines'][0]
+            event_handler['plugin_specific_configuration']['policies_to_invoke'][-1] = arg
+
         irods_config.server_config['plugin_configuration']['rule_engines'].insert(0,
            {
                 "instance_name": "irods_rule_engine_plugin-policy_engine-query_processor-instance",
@@ -247,6 +252,28 @@ curl_schema = """
 curl -X PUT -H'Content-Type: application/json' http://localhost:9200/metadata_index/_mapping/text -d '{ "properties" : { "logical_path" : { "type" : "text" }, "attribute" : { "type" : "text" }, "value" : { "type" : "text" }, "unit" : { "type" : "text" } } }'
 """
 
+collection_purge_policy = {
+    "active_policy_clauses" : ["post"],
+    "events" : ["metadata"],
+    "conditional" : {
+        "metadata_applied" : {
+            "attribute"   : "irods::indexing::index",
+            "entity_type" : "collection",
+            "operation"   : ["rm"]
+        }
+    },
+    "policy_to_invoke" : "irods_policy_indexing_metadata_purge_elasticsearch",
+    "configuration" : {
+        "hosts" : ["http://localhost:9200/"],
+        "path_field" : "logical_path.keyword",
+        "task_poll_interval_ms" : 100
+    }
+}
+
+curl_schema_keyword = """
+curl -X PUT -H'Content-Type: application/json' http://localhost:9200/metadata_index/_mapping/text -d '{ "properties" : { "logical_path" : { "type" : "text", "fields" : { "keyword" : { "type" : "keyword" } } }, "attribute" : { "type" : "text" }, "value" : { "type" : "text" }, "unit" : { "type" : "text" } } }'
+"""
+
 def assert_index_content(expected_output):
     max_iter = 10
     counter = 0
@@ -265,6 +292,18 @@ def assert_index_content(expected_output):
             print(out)
             done = True
 
+def assert_index_content_absent(unexpected_output):
+    max_iter = 10
+    counter = 0
+    while True:
+        out, _ = lib.execute_command(curl_get_wildcard)
+        if -1 == out.find(unexpected_output):
+            return
+        counter = counter + 1
+        if(counter > max_iter):
+            assert(False)
+        sleep(1)
+
 class TestElasticSearchIndexingMetadata(ResourceBase, unittest.TestCase):
     def repave_index(self):
         try:
@@ -346,5 +385,94 @@ class TestElasticSearchIndexingMetadata(ResourceBase, unittest.TestCase):
                 admin_session.assert_icommand('irm -rf ' + dir1)
                 admin_session.assert_icommand('iadmin rum')
 
+    def test_purge_full_collection_by_query(self):
+        lib.execute_command(curl_delete)
+        lib.execute_command(curl_create)
+        lib.execute_command(curl_schema_keyword)
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_purge_full_collection_by_query'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/1' + ' a1 v1 u1')
+                with metadata_event_handler_configured(collection_purge_policy):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content('"attribute" : "a0"')
+                    assert_index_content('"attribute" : "a1"')
+
+                    admin_session.assert_icommand('imeta rm -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content('"hits" : [ ]')
 
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
 
+    def test_purge_full_collection_removes_checkpoint(self):
+        lib.execute_command(curl_delete)
+        lib.execute_command(curl_create)
+        lib.execute_command(curl_schema_keyword)
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_purge_full_collection_removes_checkpoint'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,2)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+
+                # the checkpoint of an interrupted backfill
+                admin_session.assert_icommand('imeta add -C ' + dir1 + ' irods::indexing::checkpoint metadata_index::metadata 1')
+
+                policy = json.loads(json.dumps(collection_purge_policy))
+                policy['configuration']['checkpoint_store'] = 'avu'
+                with metadata_event_handler_configured(policy):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content('"attribute" : "a0"')
+                    admin_session.assert_icommand('imeta ls -C ' + dir1, 'STDOUT_SINGLELINE', 'irods::indexing::checkpoint')
+
+                    admin_session.assert_icommand('imeta rm -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content('"hits" : [ ]')
+                    admin_session.assert_icommand_fail('imeta ls -C ' + dir1, 'STDOUT_SINGLELINE', 'irods::indexing::checkpoint')
+
+            finally:
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
+
+    def test_purge_full_collection_spares_tagged_subcollection(self):
+        lib.execute_command(curl_delete)
+        lib.execute_command(curl_create)
+        lib.execute_command(curl_schema_keyword)
+        with session.make_session_for_existing_admin() as admin_session:
+            try:
+                base_name = 'test_purge_full_collection_spares_tagged_subcollection'
+                local_dir = os.path.join('/tmp/test_elastic_search_indexing_metadata', base_name)
+                dir1 = 'dir1'
+                dir1path = os.path.join(local_dir, dir1)
+                lib.make_dir_p(local_dir)
+                lib.create_directory_of_small_files(dir1path,1)
+                lib.create_directory_of_small_files(os.path.join(dir1path, 'sub'),1)
+                admin_session.assert_icommand('iput -fr ' + dir1path, 'STDOUT_SINGLELINE', 'Running recursive pre-scan')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/0' + ' a0 v0 u0')
+                admin_session.assert_icommand('imeta set -d ' + dir1+'/sub/0' + ' a1 v1 u1')
+                with metadata_event_handler_configured(collection_purge_policy):
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1/sub irods::indexing::index metadata_index::metadata elasticsearch')
+                    admin_session.assert_icommand('imeta set -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content('"attribute" : "a0"')
+                    assert_index_content('"attribute" : "a1"')
+
+                    # the sub collection is still tagged, its documents are kept
+                    admin_session.assert_icommand('imeta rm -C /tempZone/home/rods/dir1 irods::indexing::index metadata_index::metadata elasticsearch')
+                    assert_index_content_absent('"attribute" : "a0"')
+                    assert_index_content('"attribute" : "a1"')
+
+            finally:
+                admin_session.assert_icommand('imeta rm -C /tempZone/home/rods/dir1/sub irods::indexing::index metadata_index::metadata elasticsearch')
+                admin_session.assert_icommand('irm -rf ' + dir1)
+                admin_session.assert_icommand('iadmin rum')
@@ -0,0 +1,393 @@
+#ifndef IRODS_INDEXING_QOS_HPP
+#define IRODS_INDEXING_QOS_HPP
+
+// per server limits on the bytes the indexing policies read from storage
+// and send to elasticsearch, so that indexing may run alongside user
+// transfers without starving them.
+//
+// each limit is a token bucket kept in a small shared memory file, so every
+// agent and plugin instance on the server draws from the same buckets.  a
+// request may overdraw the bucket, later requests then wait out the debt.
+// work falls into priority classes: a lower class leaves part of the bucket
+// in reserve and stands aside while a higher class is waiting, so metadata
+// and small objects go ahead of large backfills.  the limits given in the
+// plugin configuration may be overridden while the server runs by a control
+// file, which is checked at most once per second.
+
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace irods::indexing {
+
+    enum class qos_priority : uint8_t {
+        // metadata and small objects
+        high   = 0,
+        // full text indexing of individual objects
+        normal = 1,
+        // collection backfills
+        low    = 2
+    };
+
+    struct qos_configuration {
+        // bytes per second, zero leaves the resource unlimited
+        uint64_t    read_bytes_per_second{};
+        uint64_t    send_bytes_per_second{};
+        // the most a bucket may hold, as time at its rate
+        uint32_t    burst_ms{1000};
+        // leading bytes of an object read one class above its own
+        uint64_t    small_object_size{1048576};
+        std::string control_file{"/etc/irods/indexing_qos.json"};
+    };
+
+    template <typename Configuration>
+    auto get_qos_configuration(const Configuration& _cfg)
+    {
+        // clang-format off
+        return qos_configuration{
+                   _cfg.get("qos_read_bytes_per_second", uint64_t{0})
+                 , _cfg.get("qos_send_bytes_per_second", uint64_t{0})
+                 , _cfg.get("qos_burst_ms",              uint32_t{1000})
+                 , _cfg.get("qos_small_object_size",     uint64_t{1048576})
+                 , _cfg.get("qos_control_file",          std::string{"/etc/irods/indexing_qos.json"})};
+        // clang-format on
+
+    } // get_qos_configuration
+
+    // the limits along with the class of the work being limited
+    struct qos_policy {
+        qos_configuration config;
+        qos_priority      priority{qos_priority::normal};
+    };
+
+    inline qos_priority promote(const qos_priority _p)
+    {
+        return qos_priority::high == _p
+               ? _p
+               : static_cast<qos_priority>(static_cast<uint8_t>(_p) - 1);
+    }
+
+    class token_bucket {
+    public:
+        explicit token_bucket(const std::string& _name)
+        {
+            const auto path = fmt::format("/dev/shm/irods_indexing_qos_{}", _name);
+
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+            if(fd_ < 0) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to open [{}] [{}]", path, std::strerror(errno)));
+            }
+
+            // growing the file is harmless should another process have
+            // created it already, its contents are kept
+            if(::ftruncate(fd_, sizeof(shared_state)) < 0) {
+                const auto e = errno;
+                ::close(fd_);
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to size [{}] [{}]", path, std::strerror(e)));
+            }
+
+            void* p = ::mmap(nullptr, sizeof(shared_state), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if(MAP_FAILED == p) {
+                const auto e = errno;
+                ::close(fd_);
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to map [{}] [{}]", path, std::strerror(e)));
+            }
+
+            state_ = static_cast<shared_state*>(p);
+
+            file_lock lk{fd_};
+            if(magic != state_->magic || version != state_->version) {
+                *state_ = shared_state{};
+                state_->magic   = magic;
+                state_->version = version;
+            }
+        }
+
+        ~token_bucket()
+        {
+            ::munmap(state_, sizeof(shared_state));
+            ::close(fd_);
+        }
+
+        token_bucket(const token_bucket&) = delete;
+        token_bucket& operator=(const token_bucket&) = delete;
+
+        // blocks until the bytes may be used at the given rate
+        void acquire(
+              const uint64_t     _bytes
+            , const uint64_t     _rate
+            , const uint64_t     _burst
+            , const qos_priority _priority)
+        {
+            // the share of the bucket each class leaves to those above it
+            static constexpr double reserve[] = {0.0, 0.25, 0.5};
+
+            constexpr int64_t min_wait_ns{1000000};
+            constexpr int64_t max_wait_ns{100000000};
+
+            const auto p     = static_cast<std::size_t>(_priority);
+            const auto floor = reserve[p] * static_cast<double>(_burst);
+
+            while(true) {
+                int64_t wait_ns{};
+
+                {
+                    // the file lock is held by the open file, so does not
+                    // exclude the other threads of this process
+                    std::lock_guard tlk{mutex_};
+                    file_lock lk{fd_};
+
+                    const auto now = now_ns();
+                    refill(now, _rate, _burst);
+
+                    bool yield{false};
+                    for(std::size_t i = 0; i < p; ++i) {
+                        yield = yield || state_->waiting_until_ns[i] > now;
+                    }
+
+                    if(!yield && state_->tokens > floor) {
+                        state_->tokens -= static_cast<double>(_bytes);
+                        return;
+                    }
+
+                    wait_ns = yield
+                              ? max_wait_ns
+                              : static_cast<int64_t>((floor - state_->tokens) * 1e9 / _rate) + 1;
+                    wait_ns = std::clamp(wait_ns, min_wait_ns, max_wait_ns);
+
+                    // lapses on its own should the waiting agent exit
+                    state_->waiting_until_ns[p] = std::max(state_->waiting_until_ns[p], now + 2 * wait_ns);
+                }
+
+                std::this_thread::sleep_for(std::chrono::nanoseconds{wait_ns});
+            }
+
+        } // acquire
+
+    private:
+        static constexpr uint32_t magic{0x51534231}; // QSB1
+        static constexpr uint32_t version{1};
+
+        struct shared_state {
+            uint32_t magic;
+            uint32_t version;
+            double   tokens;
+            int64_t  last_refill_ns;
+            // until when a request of each class is known to be waiting
+            int64_t  waiting_until_ns[3];
+        };
+
+        // released by the kernel should the holder exit while holding it
+        class file_lock {
+        public:
+            explicit file_lock(const int _fd) : fd_{_fd}
+            {
+                while(::flock(fd_, LOCK_EX) < 0 && EINTR == errno) {
+                }
+            }
+
+            ~file_lock() { ::flock(fd_, LOCK_UN); }
+
+        private:
+            const int fd_;
+        };
+
+        // monotonic time is shared by every process on the server
+        static int64_t now_ns()
+        {
+            timespec ts{};
+            ::clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+        void refill(
+              const int64_t  _now
+            , const uint64_t _rate
+            , const uint64_t _burst)
+        {
+            const auto burst = static_cast<double>(_burst);
+
+            if(0 == state_->last_refill_ns) {
+                state_->tokens = burst;
+            }
+            else {
+                const auto elapsed = static_cast<double>(_now - state_->last_refill_ns) / 1e9;
+                state_->tokens = std::min(burst, state_->tokens + elapsed * _rate);
+            }
+
+            state_->last_refill_ns = _now;
+
+        } // refill
+
+        std::mutex    mutex_;
+        int           fd_{-1};
+        shared_state* state_{};
+
+    }; // class token_bucket
+
+    // the buckets of this process, with the limits in effect
+    class qos_limiter {
+    public:
+        static qos_limiter& instance()
+        {
+            static qos_limiter l;
+            return l;
+        }
+
+        // blocks until the bytes may be read from storage
+        void throttle_read(
+              const qos_configuration& _config
+            , const qos_priority       _priority
+            , const uint64_t           _bytes)
+        {
+            const auto rate = limits(_config).first;
+            throttle("storage_read", rate, _config, _priority, _bytes);
+        }
+
+        // blocks until the bytes may be sent to elasticsearch
+        void throttle_send(
+              const qos_configuration& _config
+            , const qos_priority       _priority
+            , const uint64_t           _bytes)
+        {
+            const auto rate = limits(_config).second;
+            throttle("elasticsearch_send", rate, _config, _priority, _bytes);
+        }
+
+    private:
+        using clock_type = std::chrono::steady_clock;
+
+        qos_limiter() = default;
+
+        // the read and send rates, those of the control file taking the
+        // place of the configured ones
+        std::pair<uint64_t, uint64_t> limits(const qos_configuration& _config)
+        {
+            std::lock_guard lk{mutex_};
+
+            const auto now = clock_type::now();
+            if(_config.control_file != control_file_ || now - last_check_ >= std::chrono::seconds{1}) {
+                last_check_ = now;
+                read_control_file(_config.control_file);
+            }
+
+            return {
+                control_.value("read_bytes_per_second", _config.read_bytes_per_second)
+              , control_.value("send_bytes_per_second", _config.send_bytes_per_second)};
+
+        } // limits
+
+        // called with the mutex held
+        void read_control_file(const std::string& _path)
+        {
+            struct stat st{};
+            if(_path.empty() || ::stat(_path.c_str(), &st) < 0) {
+                control_file_ = _path;
+                control_      = json::object();
+                return;
+            }
+
+            if(_path == control_file_ && st.st_mtime == control_mtime_) {
+                return;
+            }
+
+            control_file_  = _path;
+            control_mtime_ = st.st_mtime;
+
+            try {
+                std::ifstream in{_path};
+                control_ = json::parse(in);
+                if(!control_.is_object()) {
+                    THROW(SYS_INVALID_INPUT_PARAM, "control file is not an object");
+                }
+
+                for(auto&& k : {"read_bytes_per_second", "send_bytes_per_second"}) {
+                    if(control_.contains(k) && !control_.at(k).is_number_unsigned()) {
+                        THROW(SYS_INVALID_INPUT_PARAM, fmt::format("[{}] is not a byte count", k));
+                    }
+                }
+
+                rodsLog(LOG_NOTICE, "indexing qos limits set from [%s] [%s]", _path.c_str(), control_.dump().c_str());
+            }
+            catch(const std::exception& _e) {
+                rodsLog(LOG_ERROR, "ignoring indexing qos control file [%s] [%s]", _path.c_str(), _e.what());
+                control_ = json::object();
+            }
+
+        } // read_control_file
+
+        void throttle(
+              const std::string&       _resource
+            , const uint64_t           _rate
+            , const qos_configuration& _config
+            , const qos_priority       _priority
+            , const uint64_t           _bytes)
+        {
+            if(0 == _rate || 0 == _bytes) {
+                return;
+            }
+
+            token_bucket* bucket{};
+
+            {
+                std::lock_guard lk{mutex_};
+
+                auto it = buckets_.find(_resource);
+                if(it == buckets_.end()) {
+                    std::unique_ptr<token_bucket> b;
+                    try {
+                        b = std::make_unique<token_bucket>(_resource);
+                    }
+                    catch(const irods::exception& _e) {
+                        // indexing goes on unlimited rather than failing
+                        rodsLog(LOG_ERROR, "indexing qos unavailable for [%s] [%s]", _resource.c_str(), _e.what());
+                    }
+
+                    it = buckets_.emplace(_resource, std::move(b)).first;
+                }
+
+                bucket = it->second.get();
+            }
+
+            if(!bucket) {
+                return;
+            }
+
+            const auto burst = std::max<uint64_t>(1, _rate * _config.burst_ms / 1000);
+            bucket->acquire(_bytes, _rate, burst, _priority);
+
+        } // throttle
+
+        std::mutex                                           mutex_;
+        std::map<std::string, std::unique_ptr<token_bucket>> buckets_;
+        std::string                                          control_file_;
+        time_t                                               control_mtime_{};
+        json                                                 control_ = json::object();
+        clock_type::time_point                               last_check_{};
+
+    }; // class qos_limiter
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_QOS_HPP
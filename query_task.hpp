@@ -0,0 +1,251 @@
+#ifndef IRODS_INDEXING_QUERY_TASK_HPP
+#define IRODS_INDEXING_QUERY_TASK_HPP
+
+#include "utilities.hpp"
+#include "host_selector.hpp"
+#include "tracing.hpp"
+#include "index_template.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <chrono>
+#include <thread>
+
+namespace irods::indexing {
+
+    namespace routing_mode {
+        // each document is placed on a shard by its own id
+        const std::string none{"none"};
+        // every chunk of an object is placed on the shard of its object id
+        const std::string object_id{"object_id"};
+    }
+
+    auto get_routing_mode(const pe::configuration_manager& _cfg)
+    {
+        auto m = _cfg.get("routing", routing_mode::none);
+
+        if(routing_mode::none != m && routing_mode::object_id != m) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                fmt::format("invalid routing [{}]", m));
+        }
+
+        return m;
+
+    } // get_routing_mode
+
+    struct query_task_configuration {
+        std::string path_field;
+        uint32_t    poll_interval_ms;
+        bool        route_by_object_id;
+    };
+
+    auto get_query_task_configuration(const pe::configuration_manager& _cfg)
+    {
+        // managed templates map the path as a keyword.  the keyword subfield
+        // of dynamic mapping ignores paths longer than 256 characters, which
+        // would silently be missed, so the field must then be named.
+        auto path_field = _cfg.get("path_field", std::string{});
+
+        if(path_field.empty()) {
+            if(!get_template_configuration(_cfg).managed) {
+                THROW(
+                    SYS_INVALID_INPUT_PARAM,
+                    "path_field must name a keyword field holding the whole logical path when index_templates are not managed");
+            }
+
+            path_field = "logical_path";
+        }
+
+        // clang-format off
+        return query_task_configuration{
+                   path_field
+                 , _cfg.get("task_poll_interval_ms", uint32_t{1000})
+                 , routing_mode::object_id == get_routing_mode(_cfg)};
+        // clang-format on
+
+    } // get_query_task_configuration
+
+    // the routing of the documents of an object, empty when they are not
+    // routed so that an operation goes to every shard
+    auto get_routing(
+          const bool         _route_by_object_id
+        , const std::string& _object_id)
+    {
+        return _route_by_object_id ? _object_id : std::string{};
+
+    } // get_routing
+
+    // the collection itself and everything beneath it
+    auto make_collection_query(
+          const std::string& _path_field
+        , const std::string& _collection)
+    {
+        return json{{"bool", {
+                   {"should", json::array({
+                       json{{"term",   {{_path_field, _collection}}}},
+                       json{{"prefix", {{_path_field, _collection + "/"}}}}})},
+                   {"minimum_should_match", 1}}}};
+
+    } // make_collection_query
+
+    struct query_task_options {
+        // run as a task on the cluster and poll it rather than waiting on
+        // the request, for operations which may touch many documents
+        bool        asynchronous;
+        uint32_t    poll_interval_ms;
+        // documents which changed while being processed are left as they
+        // were, which is harmless for a delete but not for an update
+        bool        conflicts_are_errors;
+        bool        log_verbose;
+        // limits the operation to the shard of a single routed object
+        std::string routing{};
+    };
+
+    // run a _delete_by_query or _update_by_query against an index, logging
+    // its progress and summarizing its result
+    irods::error run_query_task(
+          elasticsearch_client&     _client
+        , const std::string&        _index_name
+        , const std::string&        _operation
+        , const json&               _body
+        , const std::string&        _description
+        , const query_task_options& _options)
+    {
+        using clock_type = std::chrono::steady_clock;
+
+        const auto start = clock_type::now();
+
+        span s{"query_task"};
+        s.set("description", _description);
+
+        // record the outcome on the span as the task's result is returned
+        auto traced = [&s](irods::error _err) {
+            if(!_err.ok()) {
+                s.set_error(_err.result());
+            }
+
+            return _err;
+        };
+
+        if(_options.asynchronous || _options.log_verbose) {
+            rodsLog(LOG_NOTICE, "%s started", _description.c_str());
+        }
+
+        const cpr::Response submitted = _client.performRequest(
+                                            elasticlient::Client::HTTPMethod::POST
+                                          , fmt::format("{}/{}?conflicts=proceed{}{}"
+                                            , _index_name
+                                            , _operation
+                                            , _options.asynchronous ? "&wait_for_completion=false" : "&refresh=true"
+                                            , _options.routing.empty() ? "" : "&routing=" + _options.routing)
+                                          , _body.dump());
+        s.set("http.status_code", submitted.status_code);
+        if(submitted.status_code != 200) {
+            return traced(ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("{} failed code [{}] message [{}]"
+                       , _description
+                       , submitted.status_code
+                       , submitted.text)));
+        }
+
+        try {
+            auto response = json::parse(submitted.text);
+
+            if(_options.asynchronous) {
+                const auto task = response.at("task").get<std::string>();
+
+                while(true) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds{_options.poll_interval_ms});
+
+                    const cpr::Response polled = _client.performRequest(
+                                                     elasticlient::Client::HTTPMethod::GET
+                                                   , "_tasks/" + task
+                                                   , "");
+                    if(polled.status_code != 200) {
+                        return traced(ERROR(
+                                   SYS_INTERNAL_ERR,
+                                   fmt::format("failed to poll task [{}] of {} code [{}] message [{}]"
+                                   , task
+                                   , _description
+                                   , polled.status_code
+                                   , polled.text)));
+                    }
+
+                    auto result = json::parse(polled.text);
+
+                    if(_options.log_verbose) {
+                        const auto& status = result.at("task").at("status");
+                        rodsLog(
+                            LOG_NOTICE
+                          , "%s processed %llu of %llu"
+                          , _description.c_str()
+                          , status.value("updated", 0ULL)
+                            + status.value("deleted", 0ULL)
+                            + status.value("version_conflicts", 0ULL)
+                          , status.value("total", 0ULL));
+                    }
+
+                    if(!result.value("completed", false)) {
+                        continue;
+                    }
+
+                    if(result.contains("error")) {
+                        return traced(ERROR(
+                                   SYS_INTERNAL_ERR,
+                                   fmt::format("{} failed [{}]"
+                                   , _description
+                                   , result.at("error").dump())));
+                    }
+
+                    response = result.at("response");
+                    break;
+                }
+            }
+
+            const auto failures  = response.value("failures", json::array()).size();
+            const auto conflicts = response.value("version_conflicts", 0ULL);
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                                     clock_type::now() - start).count();
+
+            if(_options.asynchronous || _options.log_verbose) {
+                rodsLog(
+                    LOG_NOTICE
+                  , "%s completed, updated %llu deleted %llu in %lld seconds with %d failures and %llu conflicts"
+                  , _description.c_str()
+                  , response.value("updated", 0ULL)
+                  , response.value("deleted", 0ULL)
+                  , static_cast<long long>(elapsed)
+                  , static_cast<int>(failures)
+                  , conflicts);
+            }
+
+            if(failures > 0 || (_options.conflicts_are_errors && conflicts > 0)) {
+                return traced(ERROR(
+                           SYS_INTERNAL_ERR,
+                           fmt::format("{} encountered {} failures and {} conflicts"
+                           , _description
+                           , failures
+                           , conflicts)));
+            }
+
+            return SUCCESS();
+        }
+        catch(const json::exception& _e) {
+            return traced(ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("failed to parse result of {} [{}]"
+                       , _description
+                       , _e.what())));
+        }
+
+    } // run_query_task
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_QUERY_TASK_HPP
@@ -0,0 +1,809 @@
+#ifndef IRODS_INDEXING_RECONCILIATION_HPP
+#define IRODS_INDEXING_RECONCILIATION_HPP
+
+#include "utilities.hpp"
+#include "attribute_filter.hpp"
+#include "query_task.hpp"
+#include "rename.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include "irods_query.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <thread>
+#include <unordered_set>
+
+namespace irods::indexing {
+
+    // an object as recorded in the catalog or in an index, the digest
+    // summarizes the indexed content of the object
+    struct object_digest {
+        uint64_t    id{};
+        std::string logical_path;
+        std::string digest;
+    };
+
+    struct reconcile_configuration {
+        uint32_t page_size;
+        uint32_t repairs_per_second;
+        uint32_t report_limit;
+    };
+
+    auto get_reconcile_configuration(const pe::configuration_manager& _cfg)
+    {
+        // clang-format off
+        return reconcile_configuration{
+                   _cfg.get("reconcile_page_size",          uint32_t{1000})
+                 , _cfg.get("reconcile_repairs_per_second", uint32_t{50})
+                 , _cfg.get("reconcile_report_limit",       uint32_t{1000})};
+        // clang-format on
+
+    } // get_reconcile_configuration
+
+    // the policy was invoked directly with a collection and a mode of
+    // reconcile, optionally as a dry run which only reports differences
+    auto is_reconcile(const json& _params)
+    {
+        return _params.contains("mode") && "reconcile" == _params.at("mode");
+
+    } // is_reconcile
+
+    auto is_dry_run(const json& _params)
+    {
+        if(!_params.contains("dry_run")) {
+            return false;
+        }
+
+        const auto& d = _params.at("dry_run");
+
+        return d.is_boolean() ? d.get<bool>() : "true" == d.get<std::string>();
+
+    } // is_dry_run
+
+    // an order independent digest of a set of avus
+    class avu_digest {
+    public:
+        void add(
+              const std::string& _attribute
+            , const std::string& _value
+            , const std::string& _units)
+        {
+            avus_.push_back(_attribute + '\x1f' + _value + '\x1f' + _units);
+        }
+
+        void clear() { avus_.clear(); }
+
+        std::string digest()
+        {
+            if(avus_.empty()) {
+                return {};
+            }
+
+            std::sort(avus_.begin(), avus_.end());
+
+            irods::Hasher hasher;
+            irods::getHasher(irods::MD5_NAME, hasher);
+            for(auto&& a : avus_) {
+                hasher.update(a + '\n');
+            }
+
+            std::string d;
+            hasher.digest(d);
+
+            return d;
+        }
+
+    private:
+        std::vector<std::string> avus_;
+
+    }; // class avu_digest
+
+    // pulls rows from a general query ordered by object id, folding the
+    // consecutive rows of each object into a single digest
+    class catalog_cursor {
+    public:
+        // given the row, the current object and whether it is the first row
+        // of that object, fill in the object
+        using fold_type   = std::function<void(const std::vector<std::string>&, object_digest&, bool)>;
+        // called once all of the rows of an object have been folded
+        using finish_type = std::function<void(object_digest&)>;
+        // whether a row is folded at all, an object without any such row
+        // does not appear
+        using accept_type = std::function<bool(const std::vector<std::string>&)>;
+
+        catalog_cursor(
+              rsComm_t*          _comm
+            , const std::string& _query
+            , fold_type          _fold
+            , finish_type        _finish = {}
+            , accept_type        _accept = {})
+            : query_{std::make_unique<irods::query<rsComm_t>>(_comm, _query)}
+            , iter_{query_->begin()}
+            , fold_{_fold}
+            , finish_{_finish}
+            , accept_{_accept}
+        {
+        }
+
+        bool next(object_digest& _out)
+        {
+            while(iter_ != query_->end() && accept_ && !accept_(*iter_)) {
+                ++iter_;
+            }
+
+            if(!(iter_ != query_->end())) {
+                return false;
+            }
+
+            auto row = *iter_;
+            const auto id = std::stoull(row[0]);
+
+            _out = object_digest{id, {}, {}};
+            fold_(row, _out, true);
+
+            for(++iter_; iter_ != query_->end(); ++iter_) {
+                row = *iter_;
+                if(accept_ && !accept_(row)) {
+                    continue;
+                }
+
+                if(std::stoull(row[0]) != id) {
+                    break;
+                }
+
+                fold_(row, _out, false);
+            }
+
+            if(finish_) {
+                finish_(_out);
+            }
+
+            return true;
+
+        } // next
+
+    private:
+        std::unique_ptr<irods::query<rsComm_t>> query_;
+        irods::query<rsComm_t>::iterator        iter_;
+        fold_type                               fold_;
+        finish_type                             finish_;
+        accept_type                             accept_;
+
+    }; // class catalog_cursor
+
+    // pulls documents from an index sorted by object id with a scroll,
+    // folding the consecutive documents of each object into one digest
+    class index_cursor {
+    public:
+        using fold_type   = std::function<void(const json&, object_digest&, bool)>;
+        using finish_type = std::function<void(object_digest&)>;
+        // whether the documents of an object id are folded at all
+        using accept_type = std::function<bool(uint64_t)>;
+
+        index_cursor(
+              elasticsearch_client& _client
+            , const std::string&    _index_name
+            , const json&           _query
+            , const json&           _source
+            , const uint32_t        _page_size
+            , fold_type             _fold
+            , finish_type           _finish = {}
+            , accept_type           _accept = {})
+            : client_{_client}
+            , fold_{_fold}
+            , finish_{_finish}
+            , accept_{_accept}
+        {
+            const json body{
+                {"size",    _page_size},
+                {"query",   _query},
+                {"_source", _source},
+                {"sort",    json::array({json{{"object_id", {
+                    {"order",         "asc"},
+                    {"missing",       "_last"},
+                    {"unmapped_type", "long"}}}}})}};
+
+            fetch(_index_name + "/_search?scroll=5m", body.dump());
+        }
+
+        ~index_cursor()
+        {
+            if(scroll_id_.empty()) {
+                return;
+            }
+
+            try {
+                client_.performRequest(
+                    elasticlient::Client::HTTPMethod::DELETE
+                  , "_search/scroll"
+                  , json{{"scroll_id", json::array({scroll_id_})}}.dump());
+            }
+            catch(const std::exception& _e) {
+                rodsLog(LOG_NOTICE, "failed to clear scroll [%s]", _e.what());
+            }
+        }
+
+        index_cursor(const index_cursor&) = delete;
+        index_cursor& operator=(const index_cursor&) = delete;
+
+        // documents indexed before object ids were recorded sort last and
+        // can not be reconciled
+        auto unidentified() const { return unidentified_; }
+
+        bool next(object_digest& _out)
+        {
+            if(!peek()) {
+                return false;
+            }
+
+            const auto id = hits_[pos_].at("_source").at("object_id").get<uint64_t>();
+
+            _out = object_digest{id, {}, {}};
+            fold_(hits_[pos_].at("_source"), _out, true);
+
+            for(++pos_; peek(); ++pos_) {
+                const auto& source = hits_[pos_].at("_source");
+                if(source.at("object_id").get<uint64_t>() != id) {
+                    break;
+                }
+
+                fold_(source, _out, false);
+            }
+
+            if(finish_) {
+                finish_(_out);
+            }
+
+            return true;
+
+        } // next
+
+    private:
+        void fetch(const std::string& _path, const std::string& _body)
+        {
+            const cpr::Response response = client_.performRequest(
+                                               elasticlient::Client::HTTPMethod::POST
+                                             , _path
+                                             , _body);
+
+            // an index which does not yet exist holds nothing
+            if(response.status_code == 404 && scroll_id_.empty()) {
+                hits_ = json::array();
+                done_ = true;
+                return;
+            }
+
+            if(response.status_code != 200) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("scroll of [{}] failed code [{}] message [{}]"
+                    , _path
+                    , response.status_code
+                    , response.text));
+            }
+
+            auto result = json::parse(response.text);
+            scroll_id_  = result.value("_scroll_id", std::string{});
+            hits_       = result.at("hits").at("hits");
+            pos_        = 0;
+
+        } // fetch
+
+        // true while an accepted document with an object id remains
+        bool peek()
+        {
+            for(;; ++pos_) {
+                if(done_) {
+                    return false;
+                }
+
+                if(pos_ >= hits_.size()) {
+                    if(hits_.empty() || scroll_id_.empty()) {
+                        done_ = true;
+                        return false;
+                    }
+
+                    fetch("_search/scroll", json{{"scroll", "5m"}, {"scroll_id", scroll_id_}}.dump());
+
+                    if(hits_.empty()) {
+                        done_ = true;
+                        return false;
+                    }
+                }
+
+                const auto& source = hits_[pos_].at("_source");
+
+                if(!source.contains("object_id")) {
+                    count_unidentified();
+                    return false;
+                }
+
+                if(!accept_ || accept_(source.at("object_id").get<uint64_t>())) {
+                    return true;
+                }
+            }
+
+        } // peek
+
+        // the remaining documents have no object id, count them
+        void count_unidentified()
+        {
+            unidentified_ += hits_.size() - pos_;
+
+            while(!scroll_id_.empty()) {
+                fetch("_search/scroll", json{{"scroll", "5m"}, {"scroll_id", scroll_id_}}.dump());
+                if(hits_.empty()) {
+                    break;
+                }
+
+                unidentified_ += hits_.size();
+            }
+
+            done_ = true;
+
+        } // count_unidentified
+
+        elasticsearch_client& client_;
+        fold_type             fold_;
+        finish_type           finish_;
+        accept_type           accept_;
+        std::string           scroll_id_;
+        json                  hits_;
+        std::size_t           pos_{};
+        bool                  done_{};
+        uint64_t              unidentified_{};
+
+    }; // class index_cursor
+
+    namespace discrepancy {
+        // in the catalog but not the index
+        const std::string missing{"missing"};
+        // in the index but no longer in the catalog
+        const std::string orphaned{"orphaned"};
+        // indexed under another path
+        const std::string moved{"moved"};
+        // indexed content differs from the catalog
+        const std::string stale{"stale"};
+    }
+
+    // holds repairs to a steady rate so a reconciliation does not swamp
+    // the cluster or the catalog
+    class rate_limiter {
+    public:
+        explicit rate_limiter(const uint32_t _per_second)
+            : interval_{_per_second > 0
+                        ? std::chrono::microseconds{1000000 / _per_second}
+                        : std::chrono::microseconds{0}}
+            , next_{std::chrono::steady_clock::now()}
+        {
+        }
+
+        void acquire()
+        {
+            if(interval_.count() == 0) {
+                return;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if(next_ > now) {
+                std::this_thread::sleep_for(next_ - now);
+            }
+
+            next_ = std::max(next_, now) + interval_;
+        }
+
+    private:
+        const std::chrono::microseconds       interval_;
+        std::chrono::steady_clock::time_point next_;
+
+    }; // class rate_limiter
+
+    // merge join the objects of a collection in the catalog with those in an
+    // index, both in object id order, reporting and repairing differences.
+    // orphaned objects are purged, moved objects have their paths rewritten
+    // and missing or stale objects are handed to the reindex callback.
+    template <typename Function>
+    irods::error reconcile(
+          elasticsearch_client&           _client
+        , const query_task_configuration& _task_config
+        , const reconcile_configuration&  _config
+        , catalog_cursor&                 _catalog
+        , index_cursor&                   _index
+        , const std::string&              _collection
+        , const std::string&              _index_name
+        , const bool                      _dry_run
+        , const bool                      _log_verbose
+        , Function                        _reindex)
+    {
+        std::map<std::string, uint64_t> counts{
+            {discrepancy::missing,  0},
+            {discrepancy::orphaned, 0},
+            {discrepancy::moved,    0},
+            {discrepancy::stale,    0}};
+
+        uint64_t compared{};
+        uint64_t reported{};
+        uint64_t failed{};
+
+        rate_limiter limiter{_config.repairs_per_second};
+
+        // documents are matched by object id so that a repair applies to
+        // either layout and to every chunk of an object
+        auto purge_object = [&](const object_digest& _object) {
+            return run_query_task(
+                       _client
+                     , _index_name
+                     , "_delete_by_query"
+                     , json{{"query", {{"term", {{"object_id", _object.id}}}}}}
+                     , fmt::format("purge of object [{}] from [{}]", _object.id, _index_name)
+                     , query_task_options{
+                           false
+                         , _task_config.poll_interval_ms
+                         , false
+                         , _log_verbose
+                         , get_routing(_task_config.route_by_object_id, std::to_string(_object.id))});
+        };
+
+        auto repair = [&](
+              const std::string&   _kind
+            , const object_digest& _object
+            , const std::string&   _indexed_path) {
+            ++counts[_kind];
+
+            if(_dry_run || _log_verbose) {
+                if(reported++ < _config.report_limit) {
+                    rodsLog(
+                        LOG_NOTICE
+                      , "reconcile of [%s] in [%s] %s object [%llu] [%s]%s"
+                      , _collection.c_str()
+                      , _index_name.c_str()
+                      , _kind.c_str()
+                      , static_cast<unsigned long long>(_object.id)
+                      , _object.logical_path.c_str()
+                      , _indexed_path.empty()
+                        ? ""
+                        : fmt::format(" indexed as [{}]", _indexed_path).c_str());
+                }
+            }
+
+            if(_dry_run) {
+                return;
+            }
+
+            limiter.acquire();
+
+            irods::error err = SUCCESS();
+
+            if(discrepancy::orphaned == _kind) {
+                err = purge_object(_object);
+            }
+            else if(discrepancy::moved == _kind) {
+                err = update_renamed_path(
+                          _client
+                        , _task_config
+                        , _index_name
+                        , std::to_string(_object.id)
+                        , _indexed_path
+                        , _object.logical_path
+                        , _log_verbose);
+            }
+            else {
+                if(discrepancy::stale == _kind) {
+                    err = purge_object(_object);
+                }
+
+                if(err.ok()) {
+                    err = _reindex(_object.logical_path);
+                }
+            }
+
+            if(!err.ok()) {
+                rodsLog(LOG_ERROR, "%s", err.result().c_str());
+                ++failed;
+            }
+        };
+
+        rodsLog(
+            LOG_NOTICE
+          , "reconcile of [%s] in [%s] started%s"
+          , _collection.c_str()
+          , _index_name.c_str()
+          , _dry_run ? " as a dry run" : "");
+
+        try {
+            object_digest c{};
+            object_digest i{};
+
+            auto have_c = _catalog.next(c);
+            auto have_i = _index.next(i);
+
+            while(have_c || have_i) {
+                if(have_c && (!have_i || c.id < i.id)) {
+                    repair(discrepancy::missing, c, "");
+                    have_c = _catalog.next(c);
+                }
+                else if(have_i && (!have_c || i.id < c.id)) {
+                    repair(discrepancy::orphaned, i, "");
+                    have_i = _index.next(i);
+                }
+                else {
+                    ++compared;
+
+                    // a stale object is reindexed under its current path
+                    if(!c.digest.empty() && !i.digest.empty() && c.digest != i.digest) {
+                        repair(discrepancy::stale, c, "");
+                    }
+                    else if(c.logical_path != i.logical_path) {
+                        repair(discrepancy::moved, c, i.logical_path);
+                    }
+
+                    have_c = _catalog.next(c);
+                    have_i = _index.next(i);
+                }
+            }
+        }
+        catch(const irods::exception& _e) {
+            return ERROR(_e.code(), _e.what());
+        }
+        catch(const std::exception& _e) {
+            return ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("reconcile of [{}] in [{}] failed [{}]"
+                       , _collection
+                       , _index_name
+                       , _e.what()));
+        }
+
+        rodsLog(
+            LOG_NOTICE
+          , "reconcile of [%s] in [%s] %s, matched %llu, missing %llu, orphaned %llu, moved %llu, stale %llu, unidentified %llu, failed repairs %llu"
+          , _collection.c_str()
+          , _index_name.c_str()
+          , _dry_run ? "reported" : "completed"
+          , static_cast<unsigned long long>(compared)
+          , static_cast<unsigned long long>(counts[discrepancy::missing])
+          , static_cast<unsigned long long>(counts[discrepancy::orphaned])
+          , static_cast<unsigned long long>(counts[discrepancy::moved])
+          , static_cast<unsigned long long>(counts[discrepancy::stale])
+          , static_cast<unsigned long long>(_index.unidentified())
+          , static_cast<unsigned long long>(failed));
+
+        if(failed > 0) {
+            return ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("reconcile of [{}] in [{}] failed to repair {} objects"
+                       , _collection
+                       , _index_name
+                       , failed));
+        }
+
+        return SUCCESS();
+
+    } // reconcile
+
+    // the content of each data object is summarized by its checksum,
+    // preferring that of a good replica
+    auto make_full_text_catalog_cursor(
+          rsComm_t*          _comm
+        , const std::string& _collection)
+    {
+        return catalog_cursor{
+                   _comm
+                 , fmt::format(
+                       "SELECT ORDER(DATA_ID), COLL_NAME, DATA_NAME, DATA_CHECKSUM, DATA_REPL_STATUS WHERE COLL_NAME = '{0}' || like '{0}/%'"
+                       , _collection)
+                 , [](const std::vector<std::string>& _row, object_digest& _object, bool _first) {
+                       if(_first) {
+                           _object.logical_path = (fs::path{_row[1]} / _row[2]).string();
+                       }
+
+                       if(!_row[3].empty() && (_object.digest.empty() || "1" == _row[4])) {
+                           _object.digest = _row[3];
+                       }
+                   }};
+
+    } // make_full_text_catalog_cursor
+
+    // only the first chunk of each object records its checksum
+    auto make_full_text_index_cursor(
+          elasticsearch_client&           _client
+        , const query_task_configuration& _task_config
+        , const reconcile_configuration&  _config
+        , const std::string&              _index_name
+        , const std::string&              _collection)
+    {
+        return std::make_unique<index_cursor>(
+                   _client
+                 , _index_name
+                 , json{{"bool", {{"filter", json::array({
+                       make_collection_query(_task_config.path_field, _collection),
+                       json{{"term", {{"chunk", 0}}}}})}}}}
+                 , json::array({"object_id", "logical_path", "checksum"})
+                 , _config.page_size
+                 , [](const json& _source, object_digest& _object, bool) {
+                       _object.logical_path = _source.value("logical_path", std::string{});
+                       _object.digest       = _source.value("checksum", std::string{});
+                   });
+
+    } // make_full_text_index_cursor
+
+    // the metadata of each data object is summarized by a digest of all of
+    // its avus selected by the filter.  objects without such avus do not
+    // appear.
+    auto make_metadata_catalog_cursor(
+          rsComm_t*                               _comm
+        , const std::string&                      _collection
+        , std::shared_ptr<const attribute_filter> _filter)
+    {
+        auto digest = std::make_shared<avu_digest>();
+
+        return catalog_cursor{
+                   _comm
+                 , fmt::format(
+                       "SELECT ORDER(DATA_ID), COLL_NAME, DATA_NAME, META_DATA_ATTR_NAME, META_DATA_ATTR_VALUE, META_DATA_ATTR_UNITS WHERE COLL_NAME = '{0}' || like '{0}/%'"
+                       , _collection)
+                 , [digest](const std::vector<std::string>& _row, object_digest& _object, bool _first) {
+                       if(_first) {
+                           digest->clear();
+                           _object.logical_path = (fs::path{_row[1]} / _row[2]).string();
+                       }
+
+                       digest->add(_row[3], _row[4], _row[5]);
+                   }
+                 , [digest](object_digest& _object) {
+                       _object.digest = digest->digest();
+                   }
+                 , [_filter](const std::vector<std::string>& _row) {
+                       return _filter->accepts(_row[3], _row[5]);
+                   }};
+
+    } // make_metadata_catalog_cursor
+
+    // documents of either metadata layout, collections are skipped as only
+    // the avus applied after a collection was tagged are indexed.  a
+    // document holding no avus is never written, its object does not appear
+    // in the catalog and it is removed as orphaned.  the ids
+    // of the collections are skipped as the documents are read rather than
+    // excluded by the query, which would exceed max_terms_count for a large
+    // tree.
+    auto make_metadata_index_cursor(
+          rsComm_t*                       _comm
+        , elasticsearch_client&           _client
+        , const query_task_configuration& _task_config
+        , const reconcile_configuration&  _config
+        , const std::string&              _index_name
+        , const std::string&              _collection)
+    {
+        auto collection_ids = std::make_shared<std::unordered_set<uint64_t>>();
+        for(const auto& row : irods::query<rsComm_t>{
+                                  _comm
+                                , fmt::format(
+                                      "SELECT COLL_ID WHERE COLL_NAME = '{0}' || like '{0}/%'"
+                                      , _collection)}) {
+            collection_ids->insert(std::stoull(row[0]));
+        }
+
+        const json query{{"bool", {{"filter", json::array({
+                             make_collection_query(_task_config.path_field, _collection)})}}}};
+
+        auto digest = std::make_shared<avu_digest>();
+
+        return std::make_unique<index_cursor>(
+                   _client
+                 , _index_name
+                 , query
+                 , json::array({"object_id", "logical_path", "attribute", "value", "units", "avus"})
+                 , _config.page_size
+                 , [digest](const json& _source, object_digest& _object, bool _first) {
+                       if(_first) {
+                           digest->clear();
+                           _object.logical_path = _source.value("logical_path", std::string{});
+                       }
+
+                       if(_source.contains("avus")) {
+                           for(auto&& a : _source.at("avus")) {
+                               digest->add(
+                                   a.value("attribute", std::string{})
+                                 , a.value("value",     std::string{})
+                                 , a.value("units",     std::string{}));
+                           }
+                       }
+                       else if(_source.contains("attribute")) {
+                           digest->add(
+                               _source.value("attribute", std::string{})
+                             , _source.value("value",     std::string{})
+                             , _source.value("units",     std::string{}));
+                       }
+                   }
+                 , [digest](object_digest& _object) {
+                       _object.digest = digest->digest();
+                   }
+                 , [collection_ids](uint64_t _id) {
+                       return 0 == collection_ids->count(_id);
+                   });
+
+    } // make_metadata_index_cursor
+
+    // reconcile a collection with each index of the given type which applies
+    // to it, invoked directly with the collection
+    template <typename Function>
+    irods::error reconcile_collection(
+          rsComm_t*                        _comm
+        , elasticsearch_client&            _client
+        , const pe::configuration_manager& _cfg
+        , const std::string&               _collection
+        , const std::string&               _index_type
+        , const bool                       _dry_run
+        , const bool                       _log_verbose
+        , Function                         _reindex)
+    {
+        const auto task_config = get_query_task_configuration(_cfg);
+        const auto config      = get_reconcile_configuration(_cfg);
+
+        irods::error last_error = SUCCESS();
+
+        try {
+            const auto index_names = get_index_names_for_path(_comm, _collection, _index_type);
+            if(index_names.empty()) {
+                return ERROR(
+                           SYS_INVALID_INPUT_PARAM,
+                           fmt::format("[{}] is not a collection indexed for [{}]"
+                           , _collection
+                           , _index_type));
+            }
+
+            for(auto&& index_name : index_names) {
+                const auto is_full_text = it::full_text == _index_type;
+
+                auto catalog = is_full_text
+                               ? make_full_text_catalog_cursor(_comm, _collection)
+                               : make_metadata_catalog_cursor(_comm, _collection, get_attribute_filter(_cfg));
+
+                auto index = is_full_text
+                             ? make_full_text_index_cursor(_client, task_config, config, index_name, _collection)
+                             : make_metadata_index_cursor(_comm, _client, task_config, config, index_name, _collection);
+
+                auto err = reconcile(
+                               _client
+                             , task_config
+                             , config
+                             , catalog
+                             , *index
+                             , _collection
+                             , index_name
+                             , _dry_run
+                             , _log_verbose
+                             , [&](const std::string& _logical_path) {
+                                 return _reindex(index_name, _logical_path);
+                             });
+                if(!err.ok()) {
+                    rodsLog(LOG_ERROR, "%s", err.result().c_str());
+                    last_error = err;
+                }
+            } // for index_name
+        }
+        catch(const irods::exception& _e) {
+            return ERROR(_e.code(), _e.what());
+        }
+        catch(const std::exception& _e) {
+            return ERROR(
+                       SYS_INTERNAL_ERR,
+                       fmt::format("reconcile of [{}] failed [{}]"
+                       , _collection
+                       , _e.what()));
+        }
+
+        return last_error;
+
+    } // reconcile_collection
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_RECONCILIATION_HPP
@@ -0,0 +1,188 @@
+#ifndef IRODS_INDEXING_RENAME_HPP
+#define IRODS_INDEXING_RENAME_HPP
+
+#include "utilities.hpp"
+#include "query_task.hpp"
+#include "collection_purge.hpp"
+
+namespace irods::indexing {
+
+    const std::string source_logical_path{"source_logical_path"};
+    const std::string destination_logical_path{"destination_logical_path"};
+
+    auto get_rename_paths(const json& _params)
+    {
+        if(!_params.contains(source_logical_path)
+           || !_params.contains(destination_logical_path)) {
+            THROW(
+                SYS_INVALID_INPUT_PARAM,
+                "rename parameters did not include a source and destination logical path");
+        }
+
+        return std::make_tuple(
+                   _params.at(source_logical_path).get<std::string>()
+                 , _params.at(destination_logical_path).get<std::string>());
+
+    } // get_rename_paths
+
+    // every document of a data object, by id or by path for documents
+    // indexed before the object id was recorded
+    auto make_data_object_query(
+          const std::string& _path_field
+        , const std::string& _object_id
+        , const std::string& _logical_path)
+    {
+        return json{{"bool", {
+                   {"should", json::array({
+                       json{{"term", {{"object_id",  std::stoull(_object_id)}}}},
+                       json{{"term", {{_path_field, _logical_path}}}}})},
+                   {"minimum_should_match", 1}}}};
+
+    } // make_data_object_query
+
+    // rewrite the path of every document of a data object, or the prefix of
+    // the path of every document within a collection, in place
+    irods::error update_renamed_path(
+          elasticsearch_client&           _client
+        , const query_task_configuration& _config
+        , const std::string&              _index_name
+        , const std::string&              _object_id
+        , const std::string&              _source
+        , const std::string&              _destination
+        , const bool                      _log_verbose)
+    {
+        const auto is_collection = _object_id.empty();
+
+        // clang-format off
+        static const std::string replace_path{
+            "ctx._source.logical_path = params.destination;"};
+        static const std::string replace_prefix{
+            "ctx._source.logical_path = params.destination + ctx._source.logical_path.substring(params.source.length());"};
+        // clang-format on
+
+        const json body{
+            {"query",  is_collection
+                       ? make_collection_query(_config.path_field, _source)
+                       : make_data_object_query(_config.path_field, _object_id, _source)},
+            {"script", {
+                {"lang",   "painless"},
+                {"source", is_collection ? replace_prefix : replace_path},
+                {"params", {
+                    {"source",      _source},
+                    {"destination", _destination}}}}}};
+
+        return run_query_task(
+                   _client
+                 , _index_name
+                 , "_update_by_query"
+                 , body
+                 , fmt::format("rename of [{}] to [{}] in [{}]", _source, _destination, _index_name)
+                 , query_task_options{
+                       is_collection
+                     , _config.poll_interval_ms
+                     , true
+                     , _log_verbose
+                     , get_routing(_config.route_by_object_id, _object_id)});
+
+    } // update_renamed_path
+
+    // bring the indices of the given type in line with a data object or
+    // collection which has been renamed.  indices which apply to both the
+    // source and the destination have their paths rewritten in place, those
+    // which only applied to the source are purged, and the content is handed
+    // to the reindex callback for those which only apply at the destination.
+    template <typename Function>
+    irods::error handle_rename(
+          rsComm_t*                       _comm
+        , elasticsearch_client&           _client
+        , const query_task_configuration& _config
+        , const std::string&              _index_type
+        , const std::string&              _source
+        , const std::string&              _destination
+        , const bool                      _log_verbose
+        , Function                        _reindex)
+    {
+        const auto is_collection = fsvr::is_collection(*_comm, _destination);
+
+        auto source_colls      = get_parent_collections(_source);
+        auto destination_colls = get_parent_collections(_destination);
+
+        // the avus of a collection move with it, its own indices applied
+        // at the source as well as the destination
+        if(is_collection) {
+            source_colls.push_back(_destination);
+            destination_colls.push_back(_destination);
+        }
+
+        const auto source_indices      = get_index_names_for_collections(_comm, source_colls, _index_type);
+        const auto destination_indices = get_index_names_for_collections(_comm, destination_colls, _index_type);
+
+        const auto object_id = is_collection
+                               ? std::string{}
+                               : get_id_for_logical_path(_comm, _destination);
+
+        auto contains = [](const std::vector<std::string>& _names, const std::string& _name) {
+            return std::find(_names.begin(), _names.end(), _name) != _names.end();
+        };
+
+        irods::error last_error = SUCCESS();
+
+        for(auto&& index_name : source_indices) {
+            irods::error err = SUCCESS();
+
+            if(contains(destination_indices, index_name)) {
+                err = update_renamed_path(
+                          _client
+                        , _config
+                        , index_name
+                        , object_id
+                        , _source
+                        , _destination
+                        , _log_verbose);
+            }
+            else if(is_collection) {
+                err = purge_collection(_comm, _client, _config, _source, index_name, _index_type, _log_verbose);
+            }
+            else {
+                err = run_query_task(
+                          _client
+                        , index_name
+                        , "_delete_by_query"
+                        , json{{"query", make_data_object_query(_config.path_field, object_id, _source)}}
+                        , fmt::format("purge of [{}] from [{}]", _source, index_name)
+                        , query_task_options{
+                              false
+                            , _config.poll_interval_ms
+                            , false
+                            , _log_verbose
+                            , get_routing(_config.route_by_object_id, object_id)});
+            }
+
+            if(!err.ok()) {
+                rodsLog(LOG_ERROR, "%s", err.result().c_str());
+                last_error = err;
+            }
+        } // for index_name
+
+        std::vector<std::string> new_indices{};
+        for(auto&& index_name : destination_indices) {
+            if(!contains(source_indices, index_name)) {
+                new_indices.push_back(index_name);
+            }
+        }
+
+        if(!new_indices.empty()) {
+            auto err = _reindex(_destination, is_collection, new_indices);
+            if(!err.ok()) {
+                rodsLog(LOG_ERROR, "%s", err.result().c_str());
+                last_error = err;
+            }
+        }
+
+        return last_error;
+
+    } // handle_rename
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_RENAME_HPP
@@ -0,0 +1,440 @@
+#ifndef IRODS_INDEXING_ROLLOVER_HPP
+#define IRODS_INDEXING_ROLLOVER_HPP
+
+// rollover of the indices named by the indexing avus.  with rollover
+// enabled the configured name is a write alias over a series of backing
+// indices, <name>-000001, <name>-000002 and so on, and a new backing index
+// takes over the writes once the current one has grown past the configured
+// size, document count or age.
+//
+// documents are written through the alias, which sends them to the newest
+// backing index.  a document written before a rollover lives on in an
+// older index, so once an alias spans several indices the bulk resolves the
+// backing index of each document it writes, by a realtime get against each
+// of the older indices, and writes it there.  the per document lookups and
+// deletes search the alias rather than get by id.
+
+#include "utilities.hpp"
+#include "host_selector.hpp"
+#include "index_template.hpp"
+
+#include "policy_composition_framework_configuration_manager.hpp"
+
+#include "cpr/response.h"
+#include "elasticlient/client.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace irods::indexing {
+
+    struct rollover_configuration {
+        bool        enabled;
+        // conditions of a rollover, any of which may be left empty or zero
+        std::string max_size;
+        uint64_t    max_docs;
+        std::string max_age;
+        // how often the conditions and the backing indices are checked
+        uint32_t    check_interval_ms;
+    };
+
+    auto get_rollover_configuration(const pe::configuration_manager& _cfg)
+    {
+        // clang-format off
+        return rollover_configuration{
+                   std::string{"true"} == _cfg.get("rollover", std::string{"false"})
+                 , _cfg.get("rollover_max_size",          std::string{"50gb"})
+                 , _cfg.get("rollover_max_docs",          uint64_t{0})
+                 , _cfg.get("rollover_max_age",           std::string{})
+                 , _cfg.get("rollover_check_interval_ms", uint32_t{60000})};
+        // clang-format on
+
+    } // get_rollover_configuration
+
+    // everything the writing policies ensure of an index before writing it
+    struct index_configuration {
+        template_configuration templates;
+        rollover_configuration rollover;
+    };
+
+    auto get_index_configuration(const pe::configuration_manager& _cfg)
+    {
+        return index_configuration{
+                   get_template_configuration(_cfg)
+                 , get_rollover_configuration(_cfg)};
+
+    } // get_index_configuration
+
+    // the write aliases of this process and their backing indices
+    class rollover_aliases {
+    public:
+        using clock_type = std::chrono::steady_clock;
+
+        static rollover_aliases& instance()
+        {
+            static rollover_aliases r;
+            return r;
+        }
+
+        // create the alias along with its first backing index, unless an
+        // index of that name already exists, and roll it over once any of
+        // its conditions is met.  failures are logged, the documents are
+        // then written to whatever the name refers to.
+        void ensure(
+              elasticsearch_client&         _client
+            , const rollover_configuration& _cfg
+            , const std::string&            _alias)
+        {
+            if(!_cfg.enabled) {
+                return;
+            }
+
+            std::lock_guard lk{mutex_};
+
+            auto& a = state(_client, _cfg, _alias);
+
+            if(!refresh(_client, a, _alias)) {
+                return;
+            }
+
+            try {
+                if(!a.is_alias && !a.is_index) {
+                    create(_client, a, _alias);
+                }
+
+                if(a.is_alias) {
+                    roll_over(_client, a, _alias);
+                }
+            }
+            catch(const std::exception& _e) {
+                rodsLog(LOG_ERROR, "failed to manage rollover of [%s] [%s]", _alias.c_str(), _e.what());
+            }
+
+        } // ensure
+
+        // whether the documents of the name may be in more than one index,
+        // for a name configured for rollover
+        bool spans_indices(
+              elasticsearch_client&         _client
+            , const rollover_configuration& _cfg
+            , const std::string&            _alias)
+        {
+            if(!_cfg.enabled) {
+                return false;
+            }
+
+            std::lock_guard lk{mutex_};
+
+            auto& a = state(_client, _cfg, _alias);
+            refresh(_client, a, _alias);
+
+            return a.is_alias && a.indices > 1;
+
+        } // spans_indices
+
+        // as above, for a name already seen by this process.  other names
+        // are not looked up.
+        bool spans_indices(
+              elasticsearch_client& _client
+            , const std::string&    _alias)
+        {
+            std::lock_guard lk{mutex_};
+
+            auto it = aliases_.find(key(_client, _alias));
+            if(it == aliases_.end()) {
+                return false;
+            }
+
+            refresh(_client, it->second, _alias);
+
+            return it->second.is_alias && it->second.indices > 1;
+
+        } // spans_indices
+
+        // the backing index of each of the documents found in an index of
+        // the alias other than its write index, keyed by document id.  a
+        // bulk load disables refreshes, so the documents are fetched by id,
+        // which is realtime, rather than searched for.  a document found in
+        // none of them lives in the write index, if anywhere.
+        std::map<std::string, std::string> resolve(
+              elasticsearch_client&                                   _client
+            , const std::string&                                      _alias
+            , const std::vector<std::pair<std::string, std::string>>& _documents)
+        {
+            std::map<std::string, std::string> indices;
+
+            if(_documents.empty()) {
+                return indices;
+            }
+
+            auto docs = json::array();
+            for(auto&& i : get_read_indices(_client, _alias)) {
+                for(auto&& [id, routing] : _documents) {
+                    json d{
+                        {"_index",  i},
+                        {"_type",   "text"},
+                        {"_id",     id},
+                        {"_source", false}};
+
+                    if(!routing.empty()) {
+                        d["routing"] = routing;
+                    }
+
+                    docs.push_back(d);
+                }
+            }
+
+            if(docs.empty()) {
+                return indices;
+            }
+
+            const cpr::Response r = _client.performRequest(
+                                        elasticlient::Client::HTTPMethod::POST
+                                      , "_mget"
+                                      , json{{"docs", docs}}.dump());
+            if(200 != r.status_code) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to resolve documents of [{}] code [{}] message [{}]"
+                    , _alias
+                    , r.status_code
+                    , r.text));
+            }
+
+            for(auto&& d : json::parse(r.text).at("docs")) {
+                if(d.value("found", false)) {
+                    indices.emplace(d.at("_id").get<std::string>(), d.at("_index").get<std::string>());
+                }
+            }
+
+            return indices;
+
+        } // resolve
+
+    private:
+        // the backing indices of the alias other than its write index
+        static std::vector<std::string> get_read_indices(
+              elasticsearch_client& _client
+            , const std::string&    _alias)
+        {
+            const cpr::Response r = _client.performRequest(
+                                        elasticlient::Client::HTTPMethod::GET
+                                      , "_alias/" + _alias
+                                      , "");
+            if(200 != r.status_code) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to get the indices of [{}] code [{}] message [{}]"
+                    , _alias
+                    , r.status_code
+                    , r.text));
+            }
+
+            std::vector<std::string> indices;
+            for(auto&& [index, aliases] : json::parse(r.text).items()) {
+                const auto a = aliases.value("aliases", json::object()).value(_alias, json::object());
+                if(!a.value("is_write_index", false)) {
+                    indices.push_back(index);
+                }
+            }
+
+            return indices;
+
+        } // get_read_indices
+
+        struct alias_state {
+            rollover_configuration config;
+            // the name is a write alias, or an index which predates rollover
+            bool                   is_alias{};
+            bool                   is_index{};
+            std::size_t            indices{};
+            clock_type::time_point checked{};
+            bool                   known{};
+        };
+
+        rollover_aliases() = default;
+
+        static std::string key(
+              elasticsearch_client& _client
+            , const std::string&    _alias)
+        {
+            // the same name may be served by different clusters
+            auto k = _alias;
+            for(auto&& h : _client.configuration().hosts) {
+                k += indexer_separator + h;
+            }
+
+            return k;
+
+        } // key
+
+        alias_state& state(
+              elasticsearch_client&         _client
+            , const rollover_configuration& _cfg
+            , const std::string&            _alias)
+        {
+            auto& a = aliases_[key(_client, _alias)];
+            a.config = _cfg;
+            return a;
+        }
+
+        // look the name up again once the check interval has passed,
+        // returning whether it was
+        bool refresh(
+              elasticsearch_client& _client
+            , alias_state&          _a
+            , const std::string&    _alias)
+        {
+            const auto now = clock_type::now();
+            if(_a.known && now - _a.checked < std::chrono::milliseconds{_a.config.check_interval_ms}) {
+                return false;
+            }
+
+            _a.checked = now;
+
+            try {
+                const cpr::Response r = _client.performRequest(
+                                            elasticlient::Client::HTTPMethod::GET
+                                          , "_alias/" + _alias
+                                          , "");
+                if(200 == r.status_code) {
+                    _a.is_alias = true;
+                    _a.is_index = false;
+                    _a.indices  = json::parse(r.text).size();
+                }
+                else if(404 == r.status_code) {
+                    const cpr::Response i = _client.performRequest(
+                                                elasticlient::Client::HTTPMethod::HEAD
+                                              , _alias
+                                              , "");
+                    _a.is_alias = false;
+                    _a.is_index = (200 == i.status_code);
+                    _a.indices  = _a.is_index ? 1 : 0;
+
+                    if(_a.is_index && !_a.known) {
+                        rodsLog(
+                            LOG_NOTICE
+                          , "[%s] is an index rather than a write alias and will not be rolled over"
+                          , _alias.c_str());
+                    }
+                }
+                else {
+                    THROW(
+                        SYS_INTERNAL_ERR,
+                        fmt::format("code [{}] message [{}]", r.status_code, r.text));
+                }
+
+                _a.known = true;
+            }
+            catch(const std::exception& _e) {
+                rodsLog(LOG_ERROR, "failed to look up alias [%s] [%s]", _alias.c_str(), _e.what());
+            }
+
+            return true;
+
+        } // refresh
+
+        void create(
+              elasticsearch_client& _client
+            , alias_state&          _a
+            , const std::string&    _alias)
+        {
+            const auto first = fmt::format("{}-000001", _alias);
+
+            const cpr::Response r = _client.performRequest(
+                                        elasticlient::Client::HTTPMethod::PUT
+                                      , first
+                                      , json{{"aliases", {{_alias, {{"is_write_index", true}}}}}}.dump());
+
+            // another agent may have created it first
+            if(200 != r.status_code
+               && std::string::npos == r.text.find("resource_already_exists_exception")) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("failed to create [{}] code [{}] message [{}]", first, r.status_code, r.text));
+            }
+
+            _a.is_alias = true;
+            _a.indices  = std::max<std::size_t>(_a.indices, 1);
+
+            rodsLog(LOG_NOTICE, "created write alias [%s] over [%s]", _alias.c_str(), first.c_str());
+
+        } // create
+
+        void roll_over(
+              elasticsearch_client& _client
+            , alias_state&          _a
+            , const std::string&    _alias)
+        {
+            auto conditions = json::object();
+            if(!_a.config.max_size.empty()) {
+                conditions["max_size"] = _a.config.max_size;
+            }
+            if(_a.config.max_docs > 0) {
+                conditions["max_docs"] = _a.config.max_docs;
+            }
+            if(!_a.config.max_age.empty()) {
+                conditions["max_age"] = _a.config.max_age;
+            }
+
+            if(conditions.empty()) {
+                return;
+            }
+
+            const cpr::Response r = _client.performRequest(
+                                        elasticlient::Client::HTTPMethod::POST
+                                      , _alias + "/_rollover"
+                                      , json{{"conditions", conditions}}.dump());
+            if(200 != r.status_code) {
+                THROW(
+                    SYS_INTERNAL_ERR,
+                    fmt::format("rollover failed code [{}] message [{}]", r.status_code, r.text));
+            }
+
+            const auto result = json::parse(r.text);
+            if(result.value("rolled_over", false)) {
+                ++_a.indices;
+                rodsLog(
+                    LOG_NOTICE
+                  , "rolled [%s] over from [%s] to [%s]"
+                  , _alias.c_str()
+                  , result.value("old_index", std::string{}).c_str()
+                  , result.value("new_index", std::string{}).c_str());
+            }
+
+        } // roll_over
+
+        std::mutex                         mutex_;
+        std::map<std::string, alias_state> aliases_;
+
+    }; // class rollover_aliases
+
+    // ready the indices for writing, putting their templates before any
+    // backing index is created from them
+    inline void prepare_indices(
+          elasticsearch_client&           _client
+        , const index_configuration&      _cfg
+        , const std::vector<std::string>& _index_names
+        , const std::string&              _index_type)
+    {
+        for(auto&& n : _index_names) {
+            index_templates::instance().ensure(_client, _cfg.templates, n, _index_type);
+            rollover_aliases::instance().ensure(_client, _cfg.rollover, n);
+        }
+
+    } // prepare_indices
+
+    inline void prepare_indices(
+          elasticsearch_client&      _client
+        , const index_configuration& _cfg
+        , const std::string&         _index_name
+        , const std::string&         _index_type)
+    {
+        prepare_indices(_client, _cfg, std::vector<std::string>{_index_name}, _index_type);
+    }
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_ROLLOVER_HPP
@@ -0,0 +1,447 @@
+#ifndef IRODS_INDEXING_TRACING_HPP
+#define IRODS_INDEXING_TRACING_HPP
+
+// optional tracing of policy invocations.  each invocation is a trace whose
+// root span is opened by the policy, and whose child spans are opened by
+// the work it does on the same thread, or on another thread to which the
+// trace context has been attached.  spans are held in memory until the
+// root span ends, then the whole trace is written as one line of
+// opentelemetry (otlp) json to a local file, rotated by size.  a sampled
+// fraction of invocations is written, along with every invocation which
+// took at least the slow threshold.
+
+#include "rodsLog.h"
+
+#include "fmt/format.h"
+#include "json.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace irods::indexing {
+
+    struct tracing_configuration {
+        // traces are written here, tracing is disabled when empty
+        std::string file;
+        // fraction of invocations written regardless of their duration
+        double      sample_rate{0.01};
+        // invocations taking at least this long are always written
+        uint32_t    slow_ms{10000};
+        // size at which the file is rotated, and the rotated files kept
+        uint64_t    max_file_size{104857600};
+        uint32_t    max_files{5};
+        // spans recorded per trace, the rest are counted and dropped
+        uint32_t    max_spans{1000};
+    };
+
+    template <typename Configuration>
+    auto get_tracing_configuration(const Configuration& _cfg)
+    {
+        // clang-format off
+        return tracing_configuration{
+                   _cfg.get("trace_file",          std::string{})
+                 , _cfg.get("trace_sample_rate",   double{0.01})
+                 , _cfg.get("trace_slow_ms",       uint32_t{10000})
+                 , _cfg.get("trace_max_file_size", uint64_t{104857600})
+                 , _cfg.get("trace_max_files",     uint32_t{5})
+                 , _cfg.get("trace_max_spans",     uint32_t{1000})};
+        // clang-format on
+
+    } // get_tracing_configuration
+
+    // the spans of one policy invocation, shared by the threads working on it
+    class trace {
+    public:
+        static constexpr std::size_t npos{static_cast<std::size_t>(-1)};
+
+        explicit trace(const tracing_configuration& _cfg)
+            : cfg_{_cfg}
+            , trace_id_{random_id() + random_id()}
+        {
+            std::uniform_real_distribution<double> d{0.0, 1.0};
+            sampled_ = d(generator()) < cfg_.sample_rate;
+        }
+
+        // returns npos should the span be dropped
+        std::size_t begin(
+              const std::string& _name
+            , const std::size_t  _parent
+            , const int64_t      _start_ns)
+        {
+            std::lock_guard lk{mutex_};
+
+            if(spans_.size() >= cfg_.max_spans) {
+                ++dropped_;
+                return npos;
+            }
+
+            spans_.push_back({
+                _name
+              , random_id()
+              , npos == _parent ? std::string{} : spans_[_parent].id
+              , _start_ns});
+
+            return spans_.size() - 1;
+
+        } // begin
+
+        void end(const std::size_t _span)
+        {
+            std::lock_guard lk{mutex_};
+            spans_[_span].end_ns = now_ns();
+        }
+
+        void set(
+              const std::size_t     _span
+            , const std::string&    _key
+            , const nlohmann::json& _value)
+        {
+            std::lock_guard lk{mutex_};
+            spans_[_span].attributes.push_back({{"key", _key}, {"value", _value}});
+        }
+
+        void set_error(
+              const std::size_t  _span
+            , const std::string& _message)
+        {
+            std::lock_guard lk{mutex_};
+            spans_[_span].error   = true;
+            spans_[_span].message = _message;
+        }
+
+        // write the trace should it be sampled or slow, called once the
+        // root span has ended
+        void export_trace()
+        {
+            std::string line;
+
+            {
+                std::lock_guard lk{mutex_};
+
+                if(spans_.empty()) {
+                    return;
+                }
+
+                const auto& root = spans_.front();
+                const auto  slow = root.end_ns - root.start_ns >= int64_t{cfg_.slow_ms} * 1000000;
+                if(!sampled_ && !slow) {
+                    return;
+                }
+
+                auto spans = nlohmann::json::array();
+                for(auto&& s : spans_) {
+                    auto attributes = s.attributes;
+                    if(&s == &root) {
+                        attributes.push_back(int_attribute("trace.dropped_spans", dropped_));
+                        attributes.push_back({{"key", "trace.slow"}, {"value", {{"boolValue", slow}}}});
+                    }
+
+                    nlohmann::json span{
+                        {"traceId",           trace_id_},
+                        {"spanId",            s.id},
+                        {"name",              s.name},
+                        {"kind",              1},
+                        {"startTimeUnixNano", std::to_string(s.start_ns)},
+                        // a span still open when the trace is written ends with it
+                        {"endTimeUnixNano",   std::to_string(s.end_ns ? s.end_ns : root.end_ns)},
+                        {"attributes",        attributes},
+                        {"status",            s.error
+                                              ? nlohmann::json{{"code", 2}, {"message", s.message}}
+                                              : nlohmann::json{{"code", 0}}}};
+
+                    if(!s.parent_id.empty()) {
+                        span["parentSpanId"] = s.parent_id;
+                    }
+
+                    spans.push_back(span);
+                }
+
+                const nlohmann::json resource{
+                    {"attributes", nlohmann::json::array({
+                        string_attribute("service.name", "irods_indexing"),
+                        string_attribute("host.name",    host_name()),
+                        int_attribute("process.pid",     ::getpid())})}};
+
+                line = nlohmann::json{
+                           {"resourceSpans", nlohmann::json::array({
+                               nlohmann::json{
+                                   {"resource",   resource},
+                                   {"scopeSpans", nlohmann::json::array({
+                                       nlohmann::json{
+                                           {"scope", {{"name", "irods_indexing"}}},
+                                           {"spans", spans}}})}}})}}
+                           .dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+                line += '\n';
+            }
+
+            write_line(line);
+
+        } // export_trace
+
+        static nlohmann::json string_attribute(
+              const std::string& _key
+            , const std::string& _value)
+        {
+            return {{"key", _key}, {"value", {{"stringValue", _value}}}};
+        }
+
+        // otlp carries 64 bit integers as strings
+        static nlohmann::json int_attribute(
+              const std::string& _key
+            , const int64_t      _value)
+        {
+            return {{"key", _key}, {"value", {{"intValue", std::to_string(_value)}}}};
+        }
+
+        static int64_t now_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+    private:
+        struct span_record {
+            std::string    name;
+            std::string    id;
+            std::string    parent_id;
+            int64_t        start_ns;
+            int64_t        end_ns{};
+            nlohmann::json attributes = nlohmann::json::array();
+            bool           error{};
+            std::string    message;
+        };
+
+        static std::mt19937_64& generator()
+        {
+            thread_local std::mt19937_64 g{std::random_device{}()};
+            return g;
+        }
+
+        static std::string random_id()
+        {
+            return fmt::format("{:016x}", generator()());
+        }
+
+        static std::string host_name()
+        {
+            char name[256]{};
+            ::gethostname(name, sizeof(name) - 1);
+            return name;
+        }
+
+        // agents append whole lines to the same file, rotating it under a
+        // lock file so that only one of them does so
+        void write_line(const std::string& _line)
+        {
+            const auto lock_path = cfg_.file + ".lock";
+
+            const int lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+            if(lock_fd < 0) {
+                rodsLog(LOG_ERROR, "failed to open trace lock [%s] [%s]", lock_path.c_str(), std::strerror(errno));
+                return;
+            }
+
+            while(::flock(lock_fd, LOCK_EX) < 0 && EINTR == errno) {
+            }
+
+            struct stat st{};
+            if(0 == ::stat(cfg_.file.c_str(), &st)
+               && static_cast<uint64_t>(st.st_size) + _line.size() > cfg_.max_file_size) {
+                for(auto i = cfg_.max_files; i > 1; --i) {
+                    ::rename(
+                        fmt::format("{}.{}", cfg_.file, i - 1).c_str()
+                      , fmt::format("{}.{}", cfg_.file, i).c_str());
+                }
+
+                if(cfg_.max_files > 0) {
+                    ::rename(cfg_.file.c_str(), fmt::format("{}.1", cfg_.file).c_str());
+                }
+                else {
+                    ::unlink(cfg_.file.c_str());
+                }
+            }
+
+            const int fd = ::open(cfg_.file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+            if(fd < 0) {
+                rodsLog(LOG_ERROR, "failed to open trace file [%s] [%s]", cfg_.file.c_str(), std::strerror(errno));
+            }
+            else {
+                for(std::size_t off = 0; off < _line.size();) {
+                    const auto n = ::write(fd, _line.data() + off, _line.size() - off);
+                    if(n < 0) {
+                        if(EINTR == errno) {
+                            continue;
+                        }
+
+                        rodsLog(LOG_ERROR, "failed to write trace file [%s] [%s]", cfg_.file.c_str(), std::strerror(errno));
+                        break;
+                    }
+
+                    off += n;
+                }
+
+                ::close(fd);
+            }
+
+            ::flock(lock_fd, LOCK_UN);
+            ::close(lock_fd);
+
+        } // write_line
+
+        const tracing_configuration cfg_;
+        const std::string           trace_id_;
+        bool                        sampled_{};
+        std::mutex                  mutex_;
+        std::vector<span_record>    spans_;
+        int64_t                     dropped_{};
+
+    }; // class trace
+
+    // the trace and span under which new spans are opened on this thread
+    struct trace_context {
+        std::shared_ptr<trace> owner;
+        std::size_t            span{trace::npos};
+    };
+
+    inline trace_context& current_trace_context()
+    {
+        thread_local trace_context c;
+        return c;
+    }
+
+    // continue a trace on another thread, such as a backfill worker
+    class trace_attachment {
+    public:
+        explicit trace_attachment(const trace_context& _context)
+            : previous_{current_trace_context()}
+        {
+            current_trace_context() = _context;
+        }
+
+        ~trace_attachment() { current_trace_context() = previous_; }
+
+        trace_attachment(const trace_attachment&) = delete;
+        trace_attachment& operator=(const trace_attachment&) = delete;
+
+    private:
+        trace_context previous_;
+    };
+
+    // a timed operation, which does nothing unless a trace is in progress
+    // on this thread or it begins one
+    class span {
+    public:
+        // a child of the current span, optionally begun earlier
+        explicit span(
+              const std::string& _name
+            , const int64_t      _start_ns = trace::now_ns())
+            : previous_{current_trace_context()}
+        {
+            open(previous_.owner, _name, _start_ns);
+        }
+
+        // the root span of a policy invocation, beginning a trace when
+        // tracing is configured
+        span(
+              const tracing_configuration& _cfg
+            , const std::string&           _name)
+            : previous_{current_trace_context()}
+            , root_{!_cfg.file.empty()}
+        {
+            if(root_) {
+                open(std::make_shared<trace>(_cfg), _name, trace::now_ns());
+            }
+        }
+
+        ~span()
+        {
+            if(!active()) {
+                return;
+            }
+
+            owner_->end(index_);
+            current_trace_context() = previous_;
+
+            if(root_) {
+                try {
+                    owner_->export_trace();
+                }
+                catch(const std::exception& _e) {
+                    rodsLog(LOG_ERROR, "failed to write trace [%s]", _e.what());
+                }
+            }
+        }
+
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+        bool active() const { return owner_ && trace::npos != index_; }
+
+        void set(const std::string& _key, const std::string& _value)
+        {
+            if(active()) {
+                owner_->set(index_, _key, {{"stringValue", _value}});
+            }
+        }
+
+        void set(const std::string& _key, const char* _value)
+        {
+            set(_key, std::string{_value});
+        }
+
+        template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+        void set(const std::string& _key, const Integer _value)
+        {
+            if(active()) {
+                owner_->set(index_, _key, {{"intValue", std::to_string(_value)}});
+            }
+        }
+
+        void set_error(const std::string& _message)
+        {
+            if(active()) {
+                owner_->set_error(index_, _message);
+            }
+        }
+
+    private:
+        void open(
+              std::shared_ptr<trace> _owner
+            , const std::string&     _name
+            , const int64_t          _start_ns)
+        {
+            if(!_owner) {
+                return;
+            }
+
+            owner_ = _owner;
+            index_ = owner_->begin(_name, root_ ? trace::npos : previous_.span, _start_ns);
+
+            if(active()) {
+                current_trace_context() = {owner_, index_};
+            }
+
+        } // open
+
+        const trace_context    previous_;
+        const bool             root_{};
+        std::shared_ptr<trace> owner_;
+        std::size_t            index_{trace::npos};
+
+    }; // class span
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_TRACING_HPP
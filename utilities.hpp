@@ -1,3 +1,5 @@
+#ifndef IRODS_INDEXING_UTILITIES_HPP
+#define IRODS_INDEXING_UTILITIES_HPP
 
 #include "policy_composition_framework_policy_engine.hpp"
 
@@ -7,6 +9,12 @@
 #include "irods_hasher_factory.hpp"
 #include "MD5Strategy.hpp"
 
+#include "tracing.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace irods::indexing {
 
     namespace keywords {
@@ -193,6 +201,42 @@ namespace irods::indexing {
 
     } // extract_all
 
+    // an agent's connection carries one api call at a time.  the threads of
+    // a backfill share the connection of the invocation, each holding its
+    // mutex across every catalog query and object read.
+    std::mutex& connection_mutex(rsComm_t* _comm)
+    {
+        static std::mutex m;
+        static std::map<rsComm_t*, std::unique_ptr<std::mutex>> mutexes;
+
+        std::lock_guard lk{m};
+
+        auto& c = mutexes[_comm];
+        if(!c) {
+            c = std::make_unique<std::mutex>();
+        }
+
+        return *c;
+
+    } // connection_mutex
+
+    // the policy was invoked directly for a collection to which the indexing
+    // avu was applied, rather than for each of its objects by the query
+    // processor
+    auto invoked_for_collection(
+          rsComm_t*          _comm
+        , const json&        _params
+        , const std::string& _logical_path)
+    {
+        if(!_params.contains("metadata")
+           || !metadata_is_indexing(_params.at("metadata"))) {
+            return false;
+        }
+
+        return fsvr::is_collection(*_comm, _logical_path);
+
+    } // invoked_for_collection
+
     auto get_id_for_logical_path(
         rsComm_t*          _comm,
         const std::string& _logical_path)
@@ -214,6 +258,9 @@ namespace irods::indexing {
                         , data_name
                         , coll_name);
         }
+        span s{"catalog_query"};
+        s.set("db.statement", qstr);
+
         try {
             irods::query<rsComm_t> qobj{_comm, qstr, 1};
             if(qobj.size() > 0) {
@@ -271,15 +318,90 @@ namespace irods::indexing {
 
     } // get_index_name
 
-	auto correct_non_utf_8(std::string *str)
+    // every collection above a path, from the root down
+    auto get_parent_collections(const std::string& _logical_path)
+    {
+        std::vector<std::string> colls{};
+        for(auto pos = _logical_path.find('/', 1);
+            std::string::npos != pos;
+            pos = _logical_path.find('/', pos + 1)) {
+            colls.push_back(_logical_path.substr(0, pos));
+        }
+
+        return colls;
+
+    } // get_parent_collections
+
+    // gather the names of every index of the given type from the indexing
+    // avus of the collections
+    auto get_index_names_for_collections(
+        rsComm_t*                       _comm,
+        const std::vector<std::string>& _collections,
+        const std::string&              _index_type)
+    {
+        std::vector<std::string> names{};
+
+        if(_collections.empty()) {
+            return names;
+        }
+
+        std::string colls{};
+        for(auto&& c : _collections) {
+            colls += fmt::format("{}'{}'"
+                        , colls.empty() ? "" : ", "
+                        , c);
+        }
+
+        const auto qstr = fmt::format(
+            "SELECT META_COLL_ATTR_VALUE WHERE META_COLL_ATTR_NAME = '{}' AND META_COLL_ATTR_UNITS = '{}' AND COLL_NAME in ({})"
+            , indexing_attribute
+            , elasticsearch_units
+            , colls);
+
+        for(const auto& row : irods::query<rsComm_t>{_comm, qstr}) {
+            try {
+                auto [n, t] = extract_name_and_type(row[0]);
+                if(_index_type == t
+                   && std::find(names.begin(), names.end(), n) == names.end()) {
+                    names.push_back(n);
+                }
+            }
+            catch(const irods::exception& _e) {
+                rodsLog(LOG_ERROR, "ignoring invalid index [%s]", row[0].c_str());
+            }
+        } // for row
+
+        return names;
+
+    } // get_index_names_for_collections
+
+    // gather the names of every index of the given type which applies to
+    // a path from the indexing avus of all of its parent collections
+    auto get_index_names_for_path(
+        rsComm_t*          _comm,
+        const std::string& _logical_path,
+        const std::string& _index_type)
+    {
+        auto colls = get_parent_collections(_logical_path);
+
+        if(fsvr::is_collection(*_comm, _logical_path)) {
+            colls.push_back(_logical_path);
+        }
+
+        return get_index_names_for_collections(_comm, colls, _index_type);
+
+    } // get_index_names_for_path
+
+	// append the input to the output as valid utf-8, writing straight into
+	// the output so that no intermediate copy is made
+	void append_utf_8(std::string& to, const char* in, const std::size_t in_size)
 	{
-		int i,f_size=str->size();
+		std::size_t i,f_size=in_size;
 		unsigned char c,c2,c3,c4;
-		std::string to;
-		to.reserve(f_size);
+		to.reserve(to.size()+f_size);
 
 		for(i=0 ; i<f_size ; i++){
-			c=(unsigned char)(*str)[i];
+			c=(unsigned char)in[i];
 			if(c<32){//control char
 				if(c==9 || c==10 || c==13){//allow only \t \n \r
 					to.append(1,c);
@@ -289,12 +411,12 @@ namespace irods::indexing {
 				to.append(1,c);
 				continue;
 			}else if(c<160){//control char (nothing should be defined here either ASCI, ISO_8859-1 or UTF8, so skipping)
-				if(c2==128){//fix microsoft mess, add euro
+				if(c==128){//fix microsoft mess, add euro
 					to.append(1,226);
 					to.append(1,130);
 					to.append(1,172);
 				}
-				if(c2==133){//fix IBM mess, add NEL = \n\r
+				if(c==133){//fix IBM mess, add NEL = \n\r
 					to.append(1,10);
 					to.append(1,13);
 				}
@@ -308,7 +430,7 @@ namespace irods::indexing {
 				to.append(1,c-64);
 				continue;
 			}else if(c<224 && i+1<f_size){//possibly 2byte UTF8
-				c2=(unsigned char)(*str)[i+1];
+				c2=(unsigned char)in[i+1];
 				if(c2>127 && c2<192){//valid 2byte UTF8
 					if(c==194 && c2<160){//control char, skipping
 						;
@@ -320,8 +442,8 @@ namespace irods::indexing {
 					continue;
 				}
 			}else if(c<240 && i+2<f_size){//possibly 3byte UTF8
-				c2=(unsigned char)(*str)[i+1];
-				c3=(unsigned char)(*str)[i+2];
+				c2=(unsigned char)in[i+1];
+				c3=(unsigned char)in[i+2];
 				if(c2>127 && c2<192 && c3>127 && c3<192){//valid 3byte UTF8
 					to.append(1,c);
 					to.append(1,c2);
@@ -330,9 +452,9 @@ namespace irods::indexing {
 					continue;
 				}
 			}else if(c<245 && i+3<f_size){//possibly 4byte UTF8
-				c2=(unsigned char)(*str)[i+1];
-				c3=(unsigned char)(*str)[i+2];
-				c4=(unsigned char)(*str)[i+3];
+				c2=(unsigned char)in[i+1];
+				c3=(unsigned char)in[i+2];
+				c4=(unsigned char)in[i+3];
 				if(c2>127 && c2<192 && c3>127 && c3<192 && c4>127 && c4<192){//valid 4byte UTF8
 					to.append(1,c);
 					to.append(1,c2);
@@ -347,10 +469,16 @@ namespace irods::indexing {
 			to.append(1,c-64);
 		}
 
+	} // append_utf_8
+
+	auto correct_non_utf_8(std::string *str)
+	{
+		std::string to;
+		append_utf_8(to, str->data(), str->size());
 		return to;
 
 	} // correct_non_utf_8
 
 } // namespace irods::indexing
 
-
+#endif // IRODS_INDEXING_UTILITIES_HPP
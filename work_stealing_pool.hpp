@@ -0,0 +1,179 @@
+#ifndef IRODS_INDEXING_WORK_STEALING_POOL_HPP
+#define IRODS_INDEXING_WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace irods::indexing {
+
+    // a fixed size pool where each worker owns a queue of jobs.  jobs are
+    // dealt round robin across the queues, a worker drains its own queue
+    // from the front and, once empty, steals from the back of its peers so
+    // a few expensive jobs do not leave the remaining workers idle.
+    //
+    // submit blocks once max_pending jobs are queued or running, which
+    // bounds memory when the producer is faster than the workers.
+    class work_stealing_pool {
+    public:
+        using job_type = std::function<void()>;
+
+        explicit work_stealing_pool(
+              const uint32_t _threads
+            , const uint32_t _max_pending = 0)
+            : max_pending_{_max_pending > 0 ? _max_pending : 4 * std::max(_threads, 1u)}
+        {
+            const auto size = std::max(_threads, 1u);
+
+            for(uint32_t i = 0; i < size; ++i) {
+                queues_.push_back(std::make_unique<queue_type>());
+            }
+
+            for(uint32_t i = 0; i < size; ++i) {
+                threads_.emplace_back([this, i] { run(i); });
+            }
+
+        } // ctor
+
+        ~work_stealing_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lk{mutex_};
+                stop_ = true;
+            }
+
+            work_cv_.notify_all();
+
+            for(auto&& t : threads_) {
+                t.join();
+            }
+
+        } // dtor
+
+        work_stealing_pool(const work_stealing_pool&) = delete;
+        work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+        void submit(job_type _job)
+        {
+            std::size_t slot{};
+
+            {
+                std::unique_lock<std::mutex> lk{mutex_};
+                done_cv_.wait(lk, [this] { return pending_ < max_pending_; });
+                ++pending_;
+                slot = next_++ % queues_.size();
+            }
+
+            {
+                auto& q = *queues_[slot];
+                std::lock_guard<std::mutex> lk{q.mutex};
+                q.jobs.push_back(std::move(_job));
+            }
+
+            {
+                std::lock_guard<std::mutex> lk{mutex_};
+                ++queued_;
+            }
+
+            work_cv_.notify_one();
+
+        } // submit
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lk{mutex_};
+            done_cv_.wait(lk, [this] { return 0 == pending_; });
+
+        } // wait
+
+    private:
+        struct queue_type {
+            std::mutex           mutex;
+            std::deque<job_type> jobs;
+        };
+
+        bool take(const std::size_t _index, job_type& _job)
+        {
+            const auto size = queues_.size();
+
+            for(std::size_t i = 0; i < size; ++i) {
+                auto& q = *queues_[(_index + i) % size];
+
+                std::lock_guard<std::mutex> lk{q.mutex};
+                if(q.jobs.empty()) {
+                    continue;
+                }
+
+                if(0 == i) {
+                    _job = std::move(q.jobs.front());
+                    q.jobs.pop_front();
+                }
+                else {
+                    _job = std::move(q.jobs.back());
+                    q.jobs.pop_back();
+                }
+
+                std::lock_guard<std::mutex> g{mutex_};
+                --queued_;
+
+                return true;
+            }
+
+            return false;
+
+        } // take
+
+        void run(const std::size_t _index)
+        {
+            while(true) {
+                job_type job;
+
+                if(!take(_index, job)) {
+                    std::unique_lock<std::mutex> lk{mutex_};
+                    work_cv_.wait(lk, [this] { return stop_ || queued_ > 0; });
+                    if(stop_ && 0 == queued_) {
+                        return;
+                    }
+                    continue;
+                }
+
+                // jobs are expected to report their own errors
+                try {
+                    job();
+                }
+                catch(...) {
+                }
+
+                {
+                    std::lock_guard<std::mutex> lk{mutex_};
+                    --pending_;
+                }
+
+                done_cv_.notify_all();
+
+            } // while
+
+        } // run
+
+        const std::size_t                        max_pending_;
+        std::vector<std::unique_ptr<queue_type>> queues_;
+        std::vector<std::thread>                 threads_;
+        std::mutex                               mutex_;
+        std::condition_variable                  work_cv_;
+        std::condition_variable                  done_cv_;
+        std::size_t                              queued_{};
+        std::size_t                              pending_{};
+        std::size_t                              next_{};
+        bool                                     stop_{};
+
+    }; // class work_stealing_pool
+
+} // namespace irods::indexing
+
+#endif // IRODS_INDEXING_WORK_STEALING_POOL_HPP